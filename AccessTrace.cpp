@@ -0,0 +1,262 @@
+#include "AccessTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum PcCode { PC_SAME = 0, PC_NEXT = 1, PC_DELTA = 2 };
+
+static const uint8_t RECORD_MARKER = 0x80;
+static const size_t HEADER_SIZE = 16;
+// the first record is coded against a fetch one instruction before address 0
+static const uint32_t START_PC = uint32_t(-4);
+
+static inline uint8_t* putVarint(uint8_t* p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *p++ = uint8_t(value);
+    return p;
+}
+
+static inline uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+static inline uint32_t sizeCode(uint32_t size) { return size == 1 ? 0 : size == 2 ? 1 : 2; }
+
+AccessTraceWriter::AccessTraceWriter()
+    : fd(-1), window(nullptr), windowOffset(0), size(0), prevPc(START_PC), prevAddress(0) {}
+
+AccessTraceWriter::~AccessTraceWriter() { close(); }
+
+Status AccessTraceWriter::open(const string& base_output_name) {
+    close();
+
+    string fileName = base_output_name + "_access_trace.bin";
+    fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_SIM, "Could not open access trace file " << fileName);
+        return ERROR;
+    }
+
+    size = 0;
+    windowOffset = 0;
+    if (remap() != SUCCESS) return ERROR;
+
+    memcpy(window, ACCESS_TRACE_MAGIC, 8);
+    uint32_t version = ACCESS_TRACE_VERSION;
+    memcpy(window + 8, &version, 4);
+    memset(window + 12, 0, 4);
+    size = HEADER_SIZE;
+
+    prevPc = START_PC;
+    prevAddress = 0;
+    return SUCCESS;
+}
+
+// move the window so that it starts at the page holding the write position and make
+// the file long enough to back all of it
+Status AccessTraceWriter::remap() {
+    if (window) munmap(window, WINDOW_SIZE);
+    window = nullptr;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    windowOffset = size / page * page;
+    if (ftruncate(fd, windowOffset + WINDOW_SIZE) != 0) {
+        TRACE_ERROR(TRACE_SIM, "Could not grow access trace file: " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return ERROR;
+    }
+    void* p = mmap(nullptr, WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, windowOffset);
+    if (p == MAP_FAILED) {
+        TRACE_ERROR(TRACE_SIM, "Could not map access trace file: " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return ERROR;
+    }
+    window = static_cast<uint8_t*>(p);
+    return SUCCESS;
+}
+
+Status AccessTraceWriter::write(const AccessRecord& record) {
+    if (fd < 0) return ERROR;
+    if (size + MAX_RECORD > windowOffset + WINDOW_SIZE && remap() != SUCCESS) return ERROR;
+
+    uint8_t* start = window + (size - windowOffset);
+    uint8_t* p = start + 1;
+    uint8_t header = RECORD_MARKER | record.kind | sizeCode(record.size) << 2;
+
+    if (record.pc == prevPc) {
+        header |= PC_SAME << 4;
+    } else if (record.pc == prevPc + 4) {
+        header |= PC_NEXT << 4;
+    } else {
+        header |= PC_DELTA << 4;
+        p = putVarint(p, zigzag(record.pc - prevPc));
+    }
+    if (record.kind != ACCESS_FETCH) {
+        p = putVarint(p, zigzag(record.address - prevAddress));
+        prevAddress = record.address;
+    }
+    *start = header;
+
+    size += p - start;
+    prevPc = record.pc;
+    return SUCCESS;
+}
+
+Status AccessTraceWriter::write(const Emulator::InstructionInfo& info) {
+    if (!info.isValid || info.isOverflow) return SUCCESS;
+
+    Status status = write(AccessRecord{ACCESS_FETCH, info.pc, info.pc, 4});
+    switch (info.opcode) {
+        case OP_LBU:
+            return write(AccessRecord{ACCESS_LOAD, info.pc, info.loadAddress, 1});
+        case OP_LHU:
+            return write(AccessRecord{ACCESS_LOAD, info.pc, info.loadAddress, 2});
+        case OP_LW:
+            return write(AccessRecord{ACCESS_LOAD, info.pc, info.loadAddress, 4});
+        case OP_SB:
+            return write(AccessRecord{ACCESS_STORE, info.pc, info.storeAddress, 1});
+        case OP_SH:
+            return write(AccessRecord{ACCESS_STORE, info.pc, info.storeAddress, 2});
+        case OP_SW:
+            return write(AccessRecord{ACCESS_STORE, info.pc, info.storeAddress, 4});
+        default:
+            return status;
+    }
+}
+
+Status AccessTraceWriter::close() {
+    if (fd < 0) return SUCCESS;
+
+    Status status = SUCCESS;
+    munmap(window, WINDOW_SIZE);
+    window = nullptr;
+    if (ftruncate(fd, size) != 0) {
+        TRACE_ERROR(TRACE_SIM, "Could not trim access trace file: " << strerror(errno));
+        status = ERROR;
+    }
+    ::close(fd);
+    fd = -1;
+    return status;
+}
+
+AccessTraceReader::AccessTraceReader()
+    : data(nullptr), size(0), pos(0), prevPc(START_PC), prevAddress(0), corrupt(false) {}
+
+AccessTraceReader::~AccessTraceReader() { close(); }
+
+Status AccessTraceReader::open(const string& fileName) {
+    close();
+
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_SIM, "Unable to open access trace file " << fileName);
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+        TRACE_ERROR(TRACE_SIM, fileName << " is not an access trace");
+        ::close(fd);
+        return ERROR;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        TRACE_ERROR(TRACE_SIM, "Could not map access trace file: " << strerror(errno));
+        return ERROR;
+    }
+    data = static_cast<const uint8_t*>(p);
+    size = st.st_size;
+
+    uint32_t version;
+    memcpy(&version, data + 8, 4);
+    if (memcmp(data, ACCESS_TRACE_MAGIC, 8) != 0 || version != ACCESS_TRACE_VERSION) {
+        TRACE_ERROR(TRACE_SIM, fileName << " is not a version " << ACCESS_TRACE_VERSION
+                                        << " access trace");
+        close();
+        return ERROR;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+
+    rewind();
+    return SUCCESS;
+}
+
+void AccessTraceReader::rewind() {
+    pos = HEADER_SIZE;
+    prevPc = START_PC;
+    prevAddress = 0;
+    corrupt = false;
+}
+
+void AccessTraceReader::close() {
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+    data = nullptr;
+    size = 0;
+    pos = 0;
+}
+
+bool AccessTraceReader::next(AccessRecord& record) {
+    if (pos >= size) return false;
+    uint8_t header = data[pos];
+    // an unterminated run leaves zeros behind the last record
+    if (header == 0) return false;
+
+    size_t p = pos + 1;
+    bool truncated = false;
+    auto getVarint = [&]() -> uint32_t {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p >= size) break;
+            uint8_t byte = data[p++];
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        truncated = true;
+        return 0;
+    };
+
+    record.kind = AccessKind(header & 3);
+    record.size = 1u << ((header >> 2) & 3);
+    switch ((header >> 4) & 3) {
+        case PC_SAME:
+            record.pc = prevPc;
+            break;
+        case PC_NEXT:
+            record.pc = prevPc + 4;
+            break;
+        case PC_DELTA:
+            record.pc = prevPc + unzigzag(getVarint());
+            break;
+        default:
+            truncated = true;
+    }
+    if (record.kind == ACCESS_FETCH) {
+        record.address = record.pc;
+    } else {
+        record.address = prevAddress + unzigzag(getVarint());
+        prevAddress = record.address;
+    }
+    if (truncated || !(header & RECORD_MARKER) || record.kind > ACCESS_STORE) {
+        TRACE_ERROR(TRACE_SIM, "Corrupt access trace record at offset " << pos);
+        pos = size;
+        corrupt = true;
+        return false;
+    }
+
+    pos = p;
+    prevPc = record.pc;
+    return true;
+}
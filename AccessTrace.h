@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "Utilities.h"
+#include "emulator.h"
+
+// Binary memory-access trace, <base>_access_trace.bin: every instruction fetch, load and
+// store of a functional run, in order, so cache designs can be evaluated from it later
+// without re-executing the program (see cache_replay).
+//
+// After a 16-byte header ("MIPSMEMT", version, reserved) every access is one record:
+//   uint8  bit 7: always set, a zero byte marks the end of the data
+//          bits 0-1: kind, bits 2-3: log2 of the size in bytes
+//          bits 4-5: how the pc is coded
+//            PC_SAME   the previous record's pc
+//            PC_NEXT   the previous record's pc + 4
+//            PC_DELTA  zigzag varint delta from the previous record's pc
+//   [varint pc delta]
+//   loads and stores: zigzag varint delta from the previous load or store address
+// A fetch is its own pc. Straight-line code costs one byte per fetch and a strided
+// load or store two.
+
+#define ACCESS_TRACE_MAGIC "MIPSMEMT"
+#define ACCESS_TRACE_VERSION 1
+
+enum AccessKind { ACCESS_FETCH = 0, ACCESS_LOAD = 1, ACCESS_STORE = 2 };
+
+struct AccessRecord {
+    AccessKind kind;
+    uint32_t pc;
+    uint32_t address;
+    uint32_t size;  // bytes: 4 for fetches, 1, 2 or 4 for loads and stores
+};
+
+class AccessTraceWriter {
+   public:
+    AccessTraceWriter();
+    ~AccessTraceWriter();
+    AccessTraceWriter(const AccessTraceWriter&) = delete;
+    AccessTraceWriter& operator=(const AccessTraceWriter&) = delete;
+
+    Status open(const std::string& base_output_name);
+    Status write(const AccessRecord& record);
+    // the fetch and, for loads and stores, the data access of an executed instruction;
+    // invalid and overflowing ones never reach the caches and are skipped
+    Status write(const Emulator::InstructionInfo& info);
+    // unmaps and trims the file to the bytes actually written
+    Status close();
+
+    bool isOpen() const { return fd >= 0; }
+
+   private:
+    static const size_t WINDOW_SIZE = 16 << 20;  // bytes mapped at a time
+    static const size_t MAX_RECORD = 1 + 5 + 5;
+
+    Status remap();
+
+    int fd;
+    uint8_t* window;     // mapping of [windowOffset, windowOffset + WINDOW_SIZE)
+    size_t windowOffset;
+    size_t size;         // bytes of trace written so far
+    uint32_t prevPc;
+    uint32_t prevAddress;
+};
+
+class AccessTraceReader {
+   public:
+    AccessTraceReader();
+    ~AccessTraceReader();
+    AccessTraceReader(const AccessTraceReader&) = delete;
+    AccessTraceReader& operator=(const AccessTraceReader&) = delete;
+
+    Status open(const std::string& fileName);
+    // false at the end of the trace, or at a corrupt record (see failed())
+    bool next(AccessRecord& record);
+    // true once next() has stopped at a corrupt or truncated record
+    bool failed() const { return corrupt; }
+    // back to the first record
+    void rewind();
+    void close();
+
+   private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint32_t prevPc;
+    uint32_t prevAddress;
+    bool corrupt;
+};
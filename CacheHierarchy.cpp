@@ -0,0 +1,183 @@
+#include "CacheHierarchy.h"
+
+using namespace std;
+
+CacheHierarchy::CacheHierarchy(const CacheConfigSet& configs)
+    : iCache(new Cache(configs.icConfig, I_CACHE)), dCache(new Cache(configs.dcConfig, D_CACHE)) {
+    if (configs.l2Config.cacheSize > 0) {
+        outer.emplace_back(new Cache(configs.l2Config, D_CACHE));
+        if (configs.l3Config.cacheSize > 0) outer.emplace_back(new Cache(configs.l3Config, D_CACHE));
+    }
+    iPrefetch.prefetcher = Prefetcher::create(configs.icConfig);
+    iPrefetch.stats = PrefetchStats{0, 0, 0};
+    dPrefetch.prefetcher = Prefetcher::create(configs.dcConfig);
+    dPrefetch.stats = PrefetchStats{0, 0, 0};
+}
+
+CacheHierarchy::CacheHierarchy(const CacheHierarchy& other)
+    : iCache(new Cache(*other.iCache)), dCache(new Cache(*other.dCache)),
+      iPrefetch(other.iPrefetch), dPrefetch(other.dPrefetch) {
+    for (const auto& level : other.outer) outer.emplace_back(new Cache(*level));
+}
+
+void CacheHierarchy::endWarmup() {
+    iCache->resetStats();
+    dCache->resetStats();
+    for (auto& level : outer) level->resetStats();
+    for (PrefetchState* prefetch : {&iPrefetch, &dPrefetch}) {
+        for (auto& block : prefetch->pending) block.second = 0;
+        prefetch->stats = PrefetchStats{0, 0, 0};
+    }
+}
+
+void CacheHierarchy::save(CheckpointWriter& out) const {
+    out.section("HIER");
+    out.put(uint32_t(outer.size()));
+    iCache->save(out);
+    dCache->save(out);
+    for (const auto& level : outer) level->save(out);
+    savePrefetch(out, *iCache, iPrefetch);
+    savePrefetch(out, *dCache, dPrefetch);
+}
+
+bool CacheHierarchy::load(CheckpointReader& in) {
+    uint32_t levels;
+    if (!in.section("HIER") || !in.get(levels)) return false;
+    if (levels != outer.size()) return in.mismatch("checkpoint taken with other cache levels");
+    if (!iCache->load(in) || !dCache->load(in)) return false;
+    for (auto& level : outer) {
+        if (!level->load(in)) return false;
+    }
+    return loadPrefetch(in, *iCache, iPrefetch) && loadPrefetch(in, *dCache, dPrefetch);
+}
+
+void CacheHierarchy::savePrefetch(CheckpointWriter& out, const Cache& cache,
+                                  const PrefetchState& prefetch) {
+    out.put(cache.config.prefetcher);
+    if (!prefetch.prefetcher) return;
+    prefetch.prefetcher->save(out);
+    out.put(uint32_t(prefetch.pending.size()));
+    for (const auto& block : prefetch.pending) {
+        out.put(block.first);
+        out.put(block.second);
+    }
+    out.put(prefetch.stats);
+}
+
+bool CacheHierarchy::loadPrefetch(CheckpointReader& in, const Cache& cache,
+                                  PrefetchState& prefetch) {
+    PrefetcherKind kind;
+    if (!in.get(kind)) return false;
+    if (kind != cache.config.prefetcher) {
+        return in.mismatch("checkpoint taken with another prefetcher configuration");
+    }
+    if (!prefetch.prefetcher) return true;
+
+    uint32_t count;
+    if (!prefetch.prefetcher->load(in) || !in.get(count)) return false;
+    prefetch.pending.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t block;
+        uint64_t ready;
+        if (!in.get(block) || !in.get(ready)) return false;
+        prefetch.pending[block] = ready;
+    }
+    return in.get(prefetch.stats);
+}
+
+uint32_t CacheHierarchy::fetch(uint32_t address, uint64_t now) {
+    return accessL1(*iCache, iPrefetch, address, address, CACHE_READ, 4, now);
+}
+
+uint32_t CacheHierarchy::data(uint32_t pc, uint32_t address, CacheOperation op, uint32_t size,
+                              uint64_t now) {
+    return accessL1(*dCache, dPrefetch, pc, address, op, size, now);
+}
+
+uint32_t CacheHierarchy::accessL1(Cache& cache, PrefetchState& prefetch, uint32_t pc,
+                                  uint32_t address, CacheOperation op, uint32_t size,
+                                  uint64_t now) {
+    bool hit;
+    uint32_t delay = access(cache, 0, address, op, size, hit);
+    if (!prefetch.prefetcher) return delay;
+
+    uint32_t blockMask = ~(cache.config.blockSize - 1);
+    uint32_t victim;
+    if (cache.getLastEviction(victim)) prefetch.pending.erase(victim);
+
+    bool trigger = !hit;
+    auto pending = prefetch.pending.find(address & blockMask);
+    if (pending != prefetch.pending.end()) {
+        if (hit) {
+            prefetch.stats.useful++;
+            if (pending->second > now) {
+                prefetch.stats.late++;
+                delay += pending->second - now;
+            }
+            trigger = true;
+        }
+        prefetch.pending.erase(pending);
+    }
+
+    prefetch.blocks.clear();
+    prefetch.prefetcher->observe(pc, address, trigger, prefetch.blocks);
+    for (uint32_t block : prefetch.blocks) {
+        bool cached;
+        uint32_t latency = access(cache, 0, block, CACHE_READ, 0, cached, false);
+        if (cached) continue;
+        if (cache.getLastEviction(victim)) prefetch.pending.erase(victim);
+        prefetch.pending[block & blockMask] = now + latency;
+        prefetch.stats.issued++;
+    }
+    return delay;
+}
+
+uint32_t CacheHierarchy::access(Cache& cache, size_t level, uint32_t address, CacheOperation op,
+                                uint32_t size, bool& hit, bool demand) {
+    const CacheConfig& config = cache.config;
+    hit = demand ? cache.access(address, op, size) : !cache.prefetch(address);
+    uint32_t writeBytes = cache.getLastWriteBytes();
+    uint32_t victim;
+    bool evicted = cache.getLastEviction(victim);
+    Cache* next = level < outer.size() ? outer[level].get() : nullptr;
+
+    uint32_t delay = 0;
+    if (!hit && (op == CACHE_READ || config.writePolicy == WRITE_BACK)) {
+        delay += config.missLatency;
+        bool below;
+        if (next) delay += access(*next, level + 1, address, CACHE_READ, config.blockSize, below);
+    }
+    if (writeBytes > 0) {
+        delay += config.writebackLatency;
+        bool below;
+        if (next && config.writePolicy == WRITE_THROUGH) {
+            access(*next, level + 1, address, CACHE_WRITE, size, below);
+        } else if (next) {
+            access(*next, level + 1, victim, CACHE_WRITE, config.blockSize, below);
+        }
+    }
+    if (evicted && level > 0 && config.inclusive) {
+        delay += invalidateAbove(level, victim, config.blockSize);
+    }
+    return delay;
+}
+
+uint32_t CacheHierarchy::invalidateAbove(size_t level, uint32_t blockAddress,
+                                         uint32_t blockSize) {
+    Cache* next = level < outer.size() ? outer[level].get() : nullptr;
+    uint32_t delay = 0;
+    auto drop = [&](Cache& cache) {
+        uint32_t step = cache.config.blockSize;
+        for (uint32_t offset = 0; offset < blockSize; offset += step) {
+            uint32_t written = cache.invalidate(blockAddress + offset);
+            if (written == 0) continue;
+            delay += cache.config.writebackLatency;
+            bool below;
+            if (next) access(*next, level + 1, blockAddress + offset, CACHE_WRITE, written, below);
+        }
+    };
+    drop(*iCache);
+    drop(*dCache);
+    for (size_t i = 0; i + 1 < level; i++) drop(*outer[i]);
+    return delay;
+}
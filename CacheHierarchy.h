@@ -0,0 +1,96 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Prefetcher.h"
+#include "cache.h"
+
+// The L1 instruction and data caches and the optional unified L2 and L3 below them.
+//
+// Every level that misses charges its own missLatency, so an L1 miss that hits in L2
+// costs the L1 latency, and one that goes through L2 and L3 to memory costs all three.
+// A missed block is filled into every level it missed in. Dirty victims and
+// written-through stores go to the next level as writes; the writing level's
+// writebackLatency is charged, the next level's misses are not.
+//
+// An inclusive L2 or L3 drops every copy above it of a line it evicts. A dirty copy is
+// written back by its cache like a dirty victim, to the level below the evicting one
+// since that no longer holds the line. A non-inclusive one leaves them alone.
+// Without an L2 this is exactly the two independent L1s.
+//
+// Each L1 may have a prefetcher. A prefetch fills its block at once, but the block is
+// only ready after the latency a demand miss on it would have seen: a demand hit before
+// then counts the prefetch as late and stalls for the rest. Prefetch fills are seen by
+// the levels below like any read.
+struct PrefetchStats {
+    uint32_t issued;  // blocks filled ahead of demand
+    uint32_t useful;  // prefetched blocks later hit by demand
+    uint32_t late;    // useful ones that were not ready yet
+};
+
+class CacheHierarchy {
+   public:
+    explicit CacheHierarchy(const CacheConfigSet& configs);
+    // every level, prefetcher and pending prefetch as they are now
+    CacheHierarchy(const CacheHierarchy& other);
+    CacheHierarchy& operator=(const CacheHierarchy&) = delete;
+
+    // cycles an instruction fetch, or a load or store of size bytes by the instruction
+    // at pc, stalls for at cycle now
+    uint32_t fetch(uint32_t address, uint64_t now);
+    uint32_t data(uint32_t pc, uint32_t address, CacheOperation op, uint32_t size, uint64_t now);
+
+    const Cache& getICache() const { return *iCache; }
+    const Cache& getDCache() const { return *dCache; }
+    // nullptr when not configured
+    const Cache* getL2() const { return outer.size() > 0 ? outer[0].get() : nullptr; }
+    const Cache* getL3() const { return outer.size() > 1 ? outer[1].get() : nullptr; }
+    const PrefetchStats& getIPrefetchStats() const { return iPrefetch.stats; }
+    const PrefetchStats& getDPrefetchStats() const { return dPrefetch.stats; }
+
+    // After warming the caches up outside of cycle time: zeroes every counter and
+    // prefetch stat and makes every pending prefetch ready, keeping all cached lines
+    // and prefetcher training.
+    void endWarmup();
+
+    // every level and prefetcher, see Checkpoint.h; load() fails unless the hierarchy
+    // is configured the same
+    void save(CheckpointWriter& out) const;
+    bool load(CheckpointReader& in);
+
+   private:
+    struct PrefetchState {
+        PrefetchState() = default;
+        PrefetchState(const PrefetchState& other)
+            : prefetcher(other.prefetcher ? other.prefetcher->clone() : nullptr),
+              pending(other.pending), stats(other.stats) {}
+
+        std::unique_ptr<Prefetcher> prefetcher;
+        std::unordered_map<uint32_t, uint64_t> pending;  // prefetched block -> ready cycle
+        std::vector<uint32_t> blocks;
+        PrefetchStats stats;
+    };
+
+    uint32_t accessL1(Cache& cache, PrefetchState& prefetch, uint32_t pc, uint32_t address,
+                      CacheOperation op, uint32_t size, uint64_t now);
+    // cache is at level (0 for the L1s, 1 for L2, 2 for L3), outer[level] is below it;
+    // a prefetch is a read that leaves cached blocks alone and counts nothing
+    uint32_t access(Cache& cache, size_t level, uint32_t address, CacheOperation op,
+                    uint32_t size, bool& hit, bool demand = true);
+    // returns the writeback latency of the dirty copies dropped
+    uint32_t invalidateAbove(size_t level, uint32_t blockAddress, uint32_t blockSize);
+    // cache is the L1 the prefetcher belongs to
+    static void savePrefetch(CheckpointWriter& out, const Cache& cache,
+                             const PrefetchState& prefetch);
+    static bool loadPrefetch(CheckpointReader& in, const Cache& cache, PrefetchState& prefetch);
+
+    std::unique_ptr<Cache> iCache;
+    std::unique_ptr<Cache> dCache;
+    std::vector<std::unique_ptr<Cache>> outer;  // L2, then L3
+    PrefetchState iPrefetch;
+    PrefetchState dPrefetch;
+};
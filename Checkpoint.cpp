@@ -0,0 +1,80 @@
+#include "Checkpoint.h"
+
+#include <string.h>
+
+using namespace std;
+
+static const size_t HEADER_SIZE = 16;
+
+static uint32_t defaultInterval = 0;
+
+void setCheckpointInterval(uint32_t instructions) { defaultInterval = instructions; }
+
+uint32_t getCheckpointInterval() { return defaultInterval; }
+
+string checkpointFileName(const string& output, uint32_t din) {
+    return output + "_checkpoint_" + to_string(din) + ".bin";
+}
+
+Status CheckpointWriter::open(const string& fileName, CheckpointKind kind) {
+    name = fileName;
+    out.open(fileName, ios::binary | ios::trunc);
+    if (!out) {
+        TRACE_ERROR(TRACE_SIM, "Could not create checkpoint file " << fileName);
+        return ERROR;
+    }
+    uint32_t version = CHECKPOINT_VERSION;
+    uint32_t kindWord = kind;
+    write(CHECKPOINT_MAGIC, 8);
+    put(version);
+    put(kindWord);
+    return SUCCESS;
+}
+
+Status CheckpointWriter::close() {
+    out.close();
+    if (!out) {
+        TRACE_ERROR(TRACE_SIM, "Could not write checkpoint file " << name);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+Status CheckpointReader::open(const string& fileName) {
+    name = fileName;
+    in.open(fileName, ios::binary);
+    if (!in) {
+        TRACE_ERROR(TRACE_SIM, "Unable to open checkpoint file " << fileName);
+        return ERROR;
+    }
+
+    char header[HEADER_SIZE];
+    uint32_t version, kindWord;
+    if (!read(header, HEADER_SIZE) || memcmp(header, CHECKPOINT_MAGIC, 8) != 0) {
+        TRACE_ERROR(TRACE_SIM, fileName << " is not a checkpoint");
+        return ERROR;
+    }
+    memcpy(&version, header + 8, 4);
+    memcpy(&kindWord, header + 12, 4);
+    if (version != CHECKPOINT_VERSION || kindWord > CHECKPOINT_CYCLE) {
+        TRACE_ERROR(TRACE_SIM, fileName << " is not a version " << CHECKPOINT_VERSION
+                                        << " checkpoint");
+        return ERROR;
+    }
+    kind = CheckpointKind(kindWord);
+    return SUCCESS;
+}
+
+bool CheckpointReader::section(const char (&tag)[5]) {
+    char found[4];
+    if (read(found, 4) && memcmp(found, tag, 4) == 0) return true;
+    TRACE_ERROR(TRACE_SIM, name << ": missing or damaged " << tag << " section");
+    in.setstate(ios::failbit);
+    return false;
+}
+
+bool CheckpointReader::mismatch(const string& what) {
+    TRACE_ERROR(TRACE_SIM, name << ": " << what);
+    in.setstate(ios::failbit);
+    return false;
+}
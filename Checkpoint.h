@@ -0,0 +1,88 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+#include "Utilities.h"
+
+// Checkpoint files, <output>_checkpoint_<din>.bin: the state of a simulation at an
+// instruction boundary, to resume it later or start many detailed runs from one point.
+//
+// After a 16-byte header ("MIPSCKPT", version, kind) come tagged sections in host byte
+// order, each written and read back by the class it belongs to:
+//   "EMU "  registers, PC, branch delay state and din (Emulator)
+//   "MEM "  memory size, then every page that is not all zeros (MemoryStore)
+//   cycle checkpoints only:
+//   "HIER"  every cache level with its tag, replacement and dirty arrays, counters and
+//           generator state, and the prefetchers with their tables (CacheHierarchy)
+//   "PIPE"  pipeline latches and stall counters (CycleSimulator)
+// A functional checkpoint can start a cycle simulation, with cold caches and an empty
+// pipeline.
+
+#define CHECKPOINT_MAGIC "MIPSCKPT"
+#define CHECKPOINT_VERSION 1
+
+enum CheckpointKind { CHECKPOINT_FUNCTIONAL = 0, CHECKPOINT_CYCLE = 1 };
+
+// <output>_checkpoint_<din>.bin
+std::string checkpointFileName(const std::string& output, uint32_t din);
+
+// the first din after din that is a multiple of interval
+inline uint32_t nextCheckpointDin(uint32_t din, uint32_t interval) {
+    return (din / interval + 1) * interval;
+}
+
+// Instructions between the checkpoints the simulators behind the free functions of
+// funct.h and cycle.h write, 0 (the default) for none. Set before initializing them.
+void setCheckpointInterval(uint32_t instructions);
+uint32_t getCheckpointInterval();
+
+class CheckpointWriter {
+   public:
+    Status open(const std::string& fileName, CheckpointKind kind);
+    // ERROR if anything could not be written
+    Status close();
+
+    void write(const void* data, size_t size) {
+        out.write(static_cast<const char*>(data), size);
+    }
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "written as raw bytes");
+        write(&value, sizeof(T));
+    }
+    void section(const char (&tag)[5]) { write(tag, 4); }
+
+   private:
+    std::ofstream out;
+    std::string name;
+};
+
+class CheckpointReader {
+   public:
+    Status open(const std::string& fileName);
+    CheckpointKind getKind() const { return kind; }
+
+    // false once anything could not be read, for all calls after that too
+    bool read(void* data, size_t size) {
+        in.read(static_cast<char*>(data), size);
+        return bool(in);
+    }
+    template <typename T>
+    bool get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "read as raw bytes");
+        return read(&value, sizeof(T));
+    }
+    // reads the next section tag, with an error trace if it is not this one
+    bool section(const char (&tag)[5]);
+    // reports a section whose contents do not fit the simulator restoring it
+    bool mismatch(const std::string& what);
+
+   private:
+    std::ifstream in;
+    std::string name;
+    CheckpointKind kind;
+};
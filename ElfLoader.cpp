@@ -0,0 +1,187 @@
+#include "ElfLoader.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// header fields are big-endian whatever the host
+static uint16_t get16(const uint8_t* p) { return uint16_t(p[0] << 8 | p[1]); }
+static uint32_t get32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+#define EHDR16(field) get16(data + offsetof(Elf32_Ehdr, field))
+#define EHDR32(field) get32(data + offsetof(Elf32_Ehdr, field))
+
+namespace {
+
+// a mapped ELF file and its checked tables
+class ElfImage {
+   public:
+    ElfImage() : name(""), data(nullptr), size(0) {}
+    ~ElfImage() {
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    Status open(const char* fileName);
+    Status loadSegments(MemoryStore* memory, uint32_t& entry) const;
+    Status loadText(MemoryStore* memory, uint32_t& entry) const;
+    uint16_t type() const { return EHDR16(e_type); }
+
+   private:
+    bool inFile(uint64_t offset, uint64_t length) const { return offset + length <= size; }
+
+    const char* name;
+    const uint8_t* data;
+    size_t size;
+};
+
+}  // namespace
+
+Status ElfImage::open(const char* fileName) {
+    name = fileName;
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_MEMORY, "Unable to open ELF file " << fileName);
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Elf32_Ehdr)) {
+        TRACE_ERROR(TRACE_MEMORY, fileName << " is too short for an ELF file");
+        ::close(fd);
+        return ERROR;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        TRACE_ERROR(TRACE_MEMORY,
+                    "Could not map ELF file " << fileName << ": " << strerror(errno));
+        return ERROR;
+    }
+    data = static_cast<const uint8_t*>(p);
+    size = st.st_size;
+
+    if (memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS32 ||
+        data[EI_DATA] != ELFDATA2MSB || EHDR16(e_machine) != EM_MIPS) {
+        TRACE_ERROR(TRACE_MEMORY, fileName << " is not a big-endian MIPS ELF32 file");
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+Status ElfImage::loadSegments(MemoryStore* memory, uint32_t& entry) const {
+    uint32_t phoff = EHDR32(e_phoff);
+    uint16_t phentsize = EHDR16(e_phentsize);
+    uint16_t phnum = EHDR16(e_phnum);
+    if (phnum == 0 || phentsize < sizeof(Elf32_Phdr) ||
+        !inFile(phoff, uint64_t(phnum) * phentsize)) {
+        TRACE_ERROR(TRACE_MEMORY, name << " has no usable program headers");
+        return ERROR;
+    }
+
+    for (uint16_t i = 0; i < phnum; i++) {
+        const uint8_t* phdr = data + phoff + uint64_t(i) * phentsize;
+        if (get32(phdr + offsetof(Elf32_Phdr, p_type)) != PT_LOAD) continue;
+
+        uint32_t offset = get32(phdr + offsetof(Elf32_Phdr, p_offset));
+        uint32_t vaddr = get32(phdr + offsetof(Elf32_Phdr, p_vaddr));
+        uint32_t filesz = get32(phdr + offsetof(Elf32_Phdr, p_filesz));
+        uint32_t memsz = get32(phdr + offsetof(Elf32_Phdr, p_memsz));
+        if (filesz > memsz || !inFile(offset, filesz) || uint64_t(vaddr) + memsz > 1ull << 32) {
+            TRACE_ERROR(TRACE_MEMORY, name << ": segment " << i << " is malformed");
+            return ERROR;
+        }
+        // the file bytes, then BSS
+        if (memory->writeBytes(vaddr, data + offset, filesz) != 0 ||
+            memory->writeBytes(vaddr + filesz, nullptr, memsz - filesz) != 0) {
+            TRACE_ERROR(TRACE_MEMORY, name << ": segment " << i << " at 0x" << hex << vaddr
+                                           << " does not fit in memory");
+            return ERROR;
+        }
+    }
+
+    entry = EHDR32(e_entry);
+    return SUCCESS;
+}
+
+Status ElfImage::loadText(MemoryStore* memory, uint32_t& entry) const {
+    uint32_t shoff = EHDR32(e_shoff);
+    uint16_t shentsize = EHDR16(e_shentsize);
+    uint16_t shnum = EHDR16(e_shnum);
+    uint16_t shstrndx = EHDR16(e_shstrndx);
+    if (shentsize < sizeof(Elf32_Shdr) || shstrndx >= shnum ||
+        !inFile(shoff, uint64_t(shnum) * shentsize)) {
+        TRACE_ERROR(TRACE_MEMORY, name << " has no usable section headers");
+        return ERROR;
+    }
+
+    auto section = [&](uint16_t i) { return data + shoff + uint64_t(i) * shentsize; };
+    const uint8_t* strtab = section(shstrndx);
+    uint32_t namesOffset = get32(strtab + offsetof(Elf32_Shdr, sh_offset));
+    uint32_t namesSize = get32(strtab + offsetof(Elf32_Shdr, sh_size));
+    if (!inFile(namesOffset, namesSize)) {
+        TRACE_ERROR(TRACE_MEMORY, name << " has no usable section names");
+        return ERROR;
+    }
+
+    for (uint16_t i = 0; i < shnum; i++) {
+        const uint8_t* shdr = section(i);
+        uint32_t nameIndex = get32(shdr + offsetof(Elf32_Shdr, sh_name));
+        if (get32(shdr + offsetof(Elf32_Shdr, sh_type)) != SHT_PROGBITS ||
+            uint64_t(nameIndex) + sizeof(".text") > namesSize ||
+            memcmp(data + namesOffset + nameIndex, ".text", sizeof(".text")) != 0) {
+            continue;
+        }
+
+        uint32_t offset = get32(shdr + offsetof(Elf32_Shdr, sh_offset));
+        uint32_t length = get32(shdr + offsetof(Elf32_Shdr, sh_size));
+        if (!inFile(offset, length)) {
+            TRACE_ERROR(TRACE_MEMORY, name << ": .text is malformed");
+            return ERROR;
+        }
+        if (memory->writeBytes(0, data + offset, length) != 0) return ERROR;
+        entry = 0;
+        return SUCCESS;
+    }
+
+    TRACE_ERROR(TRACE_MEMORY, name << " has no .text section");
+    return ERROR;
+}
+
+Status loadElf(MemoryStore* memory, const char* fileName, uint32_t& entry) {
+    ElfImage image;
+    if (image.open(fileName) != SUCCESS) return ERROR;
+
+    switch (image.type()) {
+        case ET_EXEC:
+            return image.loadSegments(memory, entry);
+        case ET_REL:
+            return image.loadText(memory, entry);
+        default:
+            TRACE_ERROR(TRACE_MEMORY, fileName << " is neither an executable nor an object file");
+            return ERROR;
+    }
+}
+
+bool isElfFile(const char* fileName) {
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+    char magic[SELFMAG];
+    bool elf = read(fd, magic, SELFMAG) == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0;
+    ::close(fd);
+    return elf;
+}
+
+Status loadProgram(MemoryStore* memory, const char* fileName, uint32_t& entry) {
+    if (isElfFile(fileName)) return loadElf(memory, fileName, entry);
+
+    entry = 0;
+    return memory->loadFromFile(fileName) == 0 ? SUCCESS : ERROR;
+}
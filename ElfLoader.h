@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+#include "MemoryStore.h"
+#include "Utilities.h"
+
+// Loads a big-endian MIPS ELF32 file straight into memory, without the objcopy .bin step.
+//
+// An executable has every PT_LOAD segment copied to its virtual address, the rest of
+// the segment up to its memory size zeroed (BSS), and entry set to e_entry. A
+// relocatable object, which is what assemble.sh leaves in test/, has no segments and
+// no link addresses: like the .bin, its .text goes to address 0 and runs from there.
+Status loadElf(MemoryStore* memory, const char* fileName, uint32_t& entry);
+
+// true if the file starts with the ELF magic
+bool isElfFile(const char* fileName);
+
+// an ELF file through loadElf(), anything else as a flat image at address 0 that
+// starts at 0
+Status loadProgram(MemoryStore* memory, const char* fileName, uint32_t& entry);
@@ -1,31 +1,33 @@
 #include "MemoryStore.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 
+#include "Checkpoint.h"
 #include "Utilities.h"
 
 using namespace std;
 
-MemoryStore::MemoryStore(uint32_t startAddr, uint32_t numEntries)
-    : startAddr(startAddr) {
-    // fill memory array with 0s
-    memArr.resize(numEntries);
-    std::fill(memArr.begin(), memArr.end(), 0);
-
+MemoryStore::MemoryStore(uint32_t startAddr, uint64_t numEntries)
+    : startAddr(startAddr), memSize(numEntries), pageCount(0), tlbPage(NO_PAGE),
+      tlbData(nullptr), tlbWritable(false) {
     // If we can't initialise memory appropriately, don't return a
     // MemoryStore at all.
     assert((prepareMemory(this) == 0));
 }
 
-MemoryStore::MemoryStore(uint32_t startAddr, uint32_t numEntries, const char *fileName)
-    : startAddr(startAddr) {
-    // fill memory array with 0s
-    memArr.resize(numEntries);
-    std::fill(memArr.begin(), memArr.end(), 0);
-
+MemoryStore::MemoryStore(uint32_t startAddr, uint64_t numEntries, const char *fileName)
+    : startAddr(startAddr), memSize(numEntries), pageCount(0), tlbPage(NO_PAGE),
+      tlbData(nullptr), tlbWritable(false) {
     // If we can't initialise memory appropriately, don't return a
     // MemoryStore at all.
     assert((prepareMemory(this) == 0));
@@ -33,6 +35,108 @@ MemoryStore::MemoryStore(uint32_t startAddr, uint32_t numEntries, const char *fi
     loadFromFile(fileName);
 }
 
+MemoryStore::MemoryStore(const MemoryStore &other)
+    : startAddr(other.startAddr), memSize(other.memSize), directory(other.directory),
+      pageCount(other.pageCount), tlbPage(NO_PAGE), tlbData(nullptr), tlbWritable(false) {
+    // other's pages are shared from now on, its next write has to copy
+    other.tlbWritable.store(false, memory_order_relaxed);
+}
+
+uint8_t *MemoryStore::findPage(uint32_t relativeAddr, bool write) {
+    uint32_t pageNumber = relativeAddr >> PAGE_BITS;
+    if (pageNumber == tlbPage && (!write || tlbWritable.load(memory_order_relaxed))) {
+        return tlbData;
+    }
+
+    shared_ptr<LeafTable> &leaf = directory[pageNumber >> LEAF_BITS];
+    uint32_t index = pageNumber & ((1u << LEAF_BITS) - 1);
+    Page *page = leaf ? (*leaf)[index].get() : nullptr;
+    if (!page || write) {
+        // changing the leaf or the page, so neither may be shared with a copy
+        if (!leaf) {
+            leaf = make_shared<LeafTable>();
+        } else if (leaf.use_count() > 1) {
+            leaf = make_shared<LeafTable>(*leaf);
+        }
+        shared_ptr<Page> &slot = (*leaf)[index];
+        if (!slot) {
+            slot = make_shared<Page>();
+            memset(slot->bytes, 0, PAGE_SIZE);
+            pageCount++;
+        } else if (slot.use_count() > 1) {
+            slot = make_shared<Page>(*slot);
+        }
+        page = slot.get();
+    }
+
+    // a page that only partly fits in memSize must keep going through the range checks
+    if ((uint64_t(pageNumber) + 1) << PAGE_BITS <= memSize) {
+        tlbPage = pageNumber;
+        tlbData = page->bytes;
+        tlbWritable.store(leaf.use_count() == 1 && (*leaf)[index].use_count() == 1,
+                          memory_order_relaxed);
+    }
+    return page->bytes;
+}
+
+size_t MemoryStore::getPrivatePageCount() const {
+    size_t count = 0;
+    for (const shared_ptr<LeafTable> &leaf : directory) {
+        if (!leaf) continue;
+        for (const shared_ptr<Page> &page : *leaf) {
+            count += page && leaf.use_count() == 1 && page.use_count() == 1;
+        }
+    }
+    return count;
+}
+
+uint8_t MemoryStore::getByte(uint32_t relativeAddr) const {
+    const shared_ptr<LeafTable> &leaf = directory[relativeAddr >> (PAGE_BITS + LEAF_BITS)];
+    if (!leaf) return 0;
+    const Page *page = (*leaf)[(relativeAddr >> PAGE_BITS) & ((1u << LEAF_BITS) - 1)].get();
+    return page ? page->bytes[relativeAddr & PAGE_MASK] : 0;
+}
+
+void MemoryStore::save(CheckpointWriter &out) const {
+    static const Page zeros = {};
+    out.section("MEM ");
+    out.put(startAddr);
+    out.put(memSize);
+    for (size_t d = 0; d < directory.size(); d++) {
+        if (!directory[d]) continue;
+        for (size_t l = 0; l < directory[d]->size(); l++) {
+            const Page *page = (*directory[d])[l].get();
+            if (!page || memcmp(page->bytes, zeros.bytes, PAGE_SIZE) == 0) continue;
+            out.put(uint32_t(d << LEAF_BITS | l));
+            out.write(page->bytes, PAGE_SIZE);
+        }
+    }
+    out.put(uint32_t(NO_PAGE));
+}
+
+int MemoryStore::load(CheckpointReader &in) {
+    if (!in.section("MEM ") || !in.get(startAddr) || !in.get(memSize)) return -EINVAL;
+    if (memSize > FULL_MEMORY_SIZE) {
+        in.mismatch("memory larger than 4 GB");
+        return -EINVAL;
+    }
+    for (auto &leaf : directory) leaf.reset();
+    pageCount = 0;
+    tlbPage = NO_PAGE;
+    tlbData = nullptr;
+    tlbWritable.store(false, memory_order_relaxed);
+
+    uint32_t pageNumber = 0;
+    while (in.get(pageNumber) && pageNumber != NO_PAGE) {
+        if (uint64_t(pageNumber) << PAGE_BITS >= memSize) {
+            in.mismatch("memory page past the end of memory");
+            return -EINVAL;
+        }
+        if (!in.read(findPage(pageNumber << PAGE_BITS, true), PAGE_SIZE)) return -EINVAL;
+    }
+    return pageNumber == NO_PAGE ? 0 : -EINVAL;
+}
+
 int prepareMemory(MemoryStore *mem) {
     ifstream initMem;
     initMem.open("init_mem_image", ios::in);
@@ -48,7 +152,7 @@ int prepareMemory(MemoryStore *mem) {
         int ret = mem->setMemValue(addr, curVal, WORD_SIZE);
 
         if (ret) {
-            cout << LOG_ERROR << "Could not set initial memory value!" << endl;
+            TRACE_ERROR(TRACE_MEMORY, "Could not set initial memory value!");
             return -EINVAL;
         }
     }
@@ -65,25 +169,26 @@ int MemoryStore::getOrSetValue(bool get, uint32_t address, uint32_t &value, MemE
         case WORD_SIZE:
             break;
         default:
-            cerr << LOG_ERROR << "Invalid size passed, cannot read/write memory" << endl;
+            TRACE_ERROR(TRACE_MEMORY, "Invalid size passed, cannot read/write memory");
             return -EINVAL;
     }
 
+    // byte by byte, so an access running off the end has done everything up to there
     uint32_t relativeAddr = address - startAddr;
-    try {
+    if (get) value = 0;
+    for (uint32_t i = 0; i < byteSize; ++i) {
+        uint64_t byteAddr = uint64_t(relativeAddr) + i;
+        if (byteAddr >= memSize) {
+            TRACE_ERROR(TRACE_MEMORY, "Access violation at address 0x" << hex << address);
+            return -EINVAL;
+        }
+        uint32_t shift = (byteSize - 1 - i) * 8;
+        uint8_t *byte = findPage(uint32_t(byteAddr), !get) + (byteAddr & PAGE_MASK);
         if (get) {
-            value = 0;
-            for (uint32_t i = 0; i < byteSize; ++i) {
-                value |= (memArr.at(relativeAddr + i) << ((byteSize - 1 - i) * 8));
-            }
+            value |= uint32_t(*byte) << shift;
         } else {
-            for (uint32_t i = 0; i < byteSize; ++i) {
-                memArr.at(relativeAddr + i) = (value >> ((byteSize - 1 - i) * 8)) & 0xFF;
-            }
+            *byte = (value >> shift) & 0xFF;
         }
-    } catch (const std::out_of_range &e) {
-        cerr << LOG_ERROR << "Access violation at address 0x" << hex << address << endl;
-        return -EINVAL;
     }
 
     return 0;
@@ -98,30 +203,68 @@ int MemoryStore::setMemValue(uint32_t address, uint32_t value, MemEntrySize size
 }
 
 int MemoryStore::loadFromFile(const char *fileName) {
-    // Open instruction file
-    ifstream infile(fileName, ios::binary | ios::in);
-
-    if (infile) {
-        // Get length of the file and read instruction file into a buffer
-        infile.seekg(0, ios::end);
-        int length = infile.tellg();
-        infile.seekg(0, ios::beg);
-
-        char *buf = new char[length];
-        infile.read(buf, length);
-        infile.close();
-
-        // Initialize memory store with buffer contents
-        int memLength = length / sizeof(buf[0]);
-        int i;
-        for (i = 0; i < memLength; i++) {
-            this->setMemValue(i * BYTE_SIZE, buf[i], BYTE_SIZE);
-        }
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_MEMORY, "Unable to open memory file " << fileName);
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        TRACE_ERROR(TRACE_MEMORY, "Unable to read memory file " << fileName);
+        close(fd);
+        return ERROR;
+    }
+
+    // the image goes to address 0 on
+    uint64_t length = st.st_size;
+    if (length > 0 && (startAddr != 0 || length > memSize)) {
+        TRACE_ERROR(TRACE_MEMORY, fileName << " holds " << length
+                                           << " bytes, memory only has room for "
+                                           << (startAddr == 0 ? memSize : 0));
+        close(fd);
+        return ERROR;
+    }
+    if (length == 0) {
+        close(fd);
         return SUCCESS;
-    } else {
-        std::cerr << LOG_ERROR << "Unable to open memory file " << fileName << std::endl;
+    }
+
+    void *image = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        TRACE_ERROR(TRACE_MEMORY,
+                    "Could not map memory file " << fileName << ": " << strerror(errno));
         return ERROR;
     }
+
+    // the file is already in guest byte order
+    int status = writeBytes(0, static_cast<const uint8_t *>(image), length);
+    munmap(image, length);
+    return status;
+}
+
+int MemoryStore::writeBytes(uint32_t address, const uint8_t *bytes, uint64_t length) {
+    uint32_t relativeAddr = address - startAddr;
+    if (uint64_t(relativeAddr) + length > memSize) {
+        TRACE_ERROR(TRACE_MEMORY, length << " bytes at 0x" << hex << address << dec
+                                         << " do not fit in memory");
+        return -EINVAL;
+    }
+
+    // a page at a time
+    uint64_t done = 0;
+    while (done < length) {
+        uint32_t rel = uint32_t(relativeAddr + done);
+        uint64_t chunk = min<uint64_t>(PAGE_SIZE - (rel & PAGE_MASK), length - done);
+        uint8_t *dest = findPage(rel, true) + (rel & PAGE_MASK);
+        if (bytes) {
+            memcpy(dest, bytes + done, chunk);
+        } else {
+            memset(dest, 0, chunk);
+        }
+        done += chunk;
+    }
+    return 0;
 }
 
 int MemoryStore::printMemArray(uint32_t startAddr, uint32_t endAddr, uint32_t entrySize,
@@ -133,7 +276,7 @@ int MemoryStore::printMemArray(uint32_t startAddr, uint32_t endAddr, uint32_t en
         case WORD_SIZE:
             break;
         default:
-            cerr << LOG_ERROR << "Invalid print size passed, cannot print memory" << endl;
+            TRACE_ERROR(TRACE_MEMORY, "Invalid print size passed, cannot print memory");
             return -EINVAL;
     }
 
@@ -141,30 +284,30 @@ int MemoryStore::printMemArray(uint32_t startAddr, uint32_t endAddr, uint32_t en
     uint32_t relEnd = endAddr - this->startAddr;
     uint32_t curAddr = startAddr;
 
-    try {
-        while (relStart < relEnd) {
-            out_stream << "0x" << hex << setfill('0') << setw(WORD_WIDTH) << curAddr << ": ";
-            for (uint32_t i = 0; i < entriesPerRow; i++) {
-                if (relStart < relEnd) {
-                    out_stream << "0x";
-                    for (int j = 0; j < (int)(entrySize); j++) {
-                        out_stream << hex << setfill('0') << setw(BYTE_WIDTH)
-                                   << (uint32_t)(memArr.at(relStart + j));
+    while (relStart < relEnd) {
+        out_stream << "0x" << hex << setfill('0') << setw(WORD_WIDTH) << curAddr << ": ";
+        for (uint32_t i = 0; i < entriesPerRow; i++) {
+            if (relStart < relEnd) {
+                out_stream << "0x";
+                for (int j = 0; j < (int)(entrySize); j++) {
+                    if (uint64_t(relStart) + j >= memSize) {
+                        TRACE_ERROR(TRACE_MEMORY,
+                                    "Access violation at address 0x" << hex << curAddr);
+                        return -EINVAL;
                     }
-                    relStart += entrySize;
-                    out_stream << " ";
-                } else {
-                    out_stream << endl;
-                    return 0;
+                    out_stream << hex << setfill('0') << setw(BYTE_WIDTH)
+                               << (uint32_t)(getByte(relStart + j));
                 }
+                relStart += entrySize;
+                out_stream << " ";
+            } else {
+                out_stream << endl;
+                return 0;
             }
-
-            out_stream << endl;
-            curAddr += (uint32_t)(entrySize)*entriesPerRow;
         }
-    } catch (const std::out_of_range &e) {
-        cerr << LOG_ERROR << "Access violation at address 0x" << hex << curAddr << endl;
-        return -EINVAL;
+
+        out_stream << endl;
+        curAddr += (uint32_t)(entrySize)*entriesPerRow;
     }
 
     return 0;
@@ -182,7 +325,7 @@ void dumpMemoryState(MemoryStore *mem, const std::string &base_output_name) {
 
     MemoryStore *memImpl = dynamic_cast<MemoryStore *>(mem);
     if (!memImpl) {
-        cerr << LOG_ERROR << "Invalid memory store passed to dump function" << endl;
+        TRACE_ERROR(TRACE_MEMORY, "Invalid memory store passed to dump function");
     }
     ifstream memRange;
     memRange.open("print_mem_range", ios::in);
@@ -202,6 +345,6 @@ void dumpMemoryState(MemoryStore *mem, const std::string &base_output_name) {
         mem_out << "End Memory State" << endl;
         mem_out << "---------------------" << endl;
     } else {
-        cerr << LOG_ERROR << "Could not create memory state dump file" << endl;
+        TRACE_ERROR(TRACE_MEMORY, "Could not create memory state dump file");
     }
 }
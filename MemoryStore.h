@@ -1,11 +1,19 @@
 #pragma once
 #include <inttypes.h>
+#include <string.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
-#include <vector>
 
 // The memory is 64 KB large.
 #define MEMORY_SIZE 0x10000
+// The whole 32-bit address space, for workloads that do not fit in MEMORY_SIZE.
+#define FULL_MEMORY_SIZE 0x100000000ull
+
+class CheckpointReader;
+class CheckpointWriter;
 
 // The various sizes at which you can manipulate the memory.
 enum MemEntrySize { BYTE_SIZE = 1, HALF_SIZE = 2, WORD_SIZE = 4 };
@@ -17,21 +25,163 @@ static const uint32_t WORD_WIDTH = 8;
 // A memory abstraction interface. Allows values to be set and retrieved at a number of
 // different size granularities. The implementation is also capable of printing out memory
 // values over a given address range.
+//
+// Memory is sparse: 4 KB pages behind a two-level page table, allocated zeroed on the
+// first access, so a store can cover all 4 GB and only pay for what the program
+// touches. The last page accessed is remembered in a one-entry TLB, which the inline
+// accessors below check before anything else.
+//
+// Copies share their page tables and pages copy-on-write: a copy costs a page directory
+// and, from then on, every page either side writes. A store may be copied by several
+// threads at once, but not while it is being accessed.
 class MemoryStore {
    private:
+    static const uint32_t PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+    static const uint32_t LEAF_BITS = 10;  // pages per second-level table
+    static const uint32_t DIRECTORY_BITS = 32 - PAGE_BITS - LEAF_BITS;
+    static const uint32_t NO_PAGE = ~0u;
+
+    struct Page {
+        uint8_t bytes[PAGE_SIZE];
+    };
+    typedef std::array<std::shared_ptr<Page>, 1u << LEAF_BITS> LeafTable;
+
     uint32_t startAddr;
-    std::vector<uint8_t> memArr;
+    uint64_t memSize;  // bytes from startAddr on that may be accessed
+    std::array<std::shared_ptr<LeafTable>, 1u << DIRECTORY_BITS> directory;
+    size_t pageCount;
+
+    // page number (of addresses relative to startAddr) and data of the last page used;
+    // only ever a page that is allocated and wholly inside memSize. It may only be
+    // written through while tlbWritable, that is while no copy shares it; copying the
+    // store clears that.
+    uint32_t tlbPage;
+    uint8_t* tlbData;
+    mutable std::atomic<bool> tlbWritable;
 
     int getOrSetValue(bool get, uint32_t address, uint32_t& value, MemEntrySize size);
+    // the page holding relativeAddr, allocated if it is new and made private to this
+    // store first if it is to be written; refills the TLB
+    uint8_t* findPage(uint32_t relativeAddr, bool write);
+    // without allocating, for printing
+    uint8_t getByte(uint32_t relativeAddr) const;
+
+    // host order <-> the big-endian order of the emulated machine
+    static uint32_t swap32(uint32_t v) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap32(v);
+#else
+        return v;
+#endif
+    }
+    static uint16_t swap16(uint16_t v) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap16(v);
+#else
+        return v;
+#endif
+    }
+
+    // where bytes [address, address + size) live if the TLB covers all of them
+    uint8_t* tlbHit(uint32_t address, uint32_t size) const {
+        uint32_t relativeAddr = address - startAddr;
+        if ((relativeAddr >> PAGE_BITS) != tlbPage ||
+            (relativeAddr & PAGE_MASK) > PAGE_SIZE - size) {
+            return nullptr;
+        }
+        return tlbData + (relativeAddr & PAGE_MASK);
+    }
+    uint8_t* tlbWriteHit(uint32_t address, uint32_t size) const {
+        return tlbWritable.load(std::memory_order_relaxed) ? tlbHit(address, size) : nullptr;
+    }
 
    public:
-    MemoryStore(uint32_t startAddr, uint32_t numEntries);
-    MemoryStore(uint32_t startAddr, uint32_t numEntries, const char* fileName);
+    // numEntries bytes from startAddr on, up to FULL_MEMORY_SIZE
+    MemoryStore(uint32_t startAddr, uint64_t numEntries);
+    MemoryStore(uint32_t startAddr, uint64_t numEntries, const char* fileName);
+    // copy-on-write, see above
+    MemoryStore(const MemoryStore& other);
+    MemoryStore& operator=(const MemoryStore&) = delete;
     ~MemoryStore(){};
 
     int loadFromFile(const char* fileName);
+    // copies length bytes, already in guest byte order, to address on; zeros them
+    // when bytes is null
+    int writeBytes(uint32_t address, const uint8_t* bytes, uint64_t length);
     int getMemValue(uint32_t address, uint32_t& value, MemEntrySize size);
     int setMemValue(uint32_t address, uint32_t value, MemEntrySize size);
+
+    // Fast paths for the emulator: a TLB check and one copy. Other pages, accesses that
+    // straddle a page, and out-of-range ones take getMemValue()/setMemValue(), with the
+    // same partial effect and error trace.
+    // @return false on an access violation
+    bool read32(uint32_t address, uint32_t& value) {
+        const uint8_t* p = tlbHit(address, 4);
+        if (!p) return getOrSetValue(true, address, value, WORD_SIZE) == 0;
+        uint32_t raw;
+        memcpy(&raw, p, 4);
+        value = swap32(raw);
+        return true;
+    }
+    bool read16(uint32_t address, uint32_t& value) {
+        const uint8_t* p = tlbHit(address, 2);
+        if (!p) return getOrSetValue(true, address, value, HALF_SIZE) == 0;
+        uint16_t raw;
+        memcpy(&raw, p, 2);
+        value = swap16(raw);
+        return true;
+    }
+    bool read8(uint32_t address, uint32_t& value) {
+        const uint8_t* p = tlbHit(address, 1);
+        if (!p) return getOrSetValue(true, address, value, BYTE_SIZE) == 0;
+        value = *p;
+        return true;
+    }
+    bool write32(uint32_t address, uint32_t value) {
+        uint8_t* p = tlbWriteHit(address, 4);
+        if (!p) return getOrSetValue(false, address, value, WORD_SIZE) == 0;
+        uint32_t raw = swap32(value);
+        memcpy(p, &raw, 4);
+        return true;
+    }
+    bool write16(uint32_t address, uint32_t value) {
+        uint8_t* p = tlbWriteHit(address, 2);
+        if (!p) return getOrSetValue(false, address, value, HALF_SIZE) == 0;
+        uint16_t raw = swap16(uint16_t(value));
+        memcpy(p, &raw, 2);
+        return true;
+    }
+    bool write8(uint32_t address, uint32_t value) {
+        uint8_t* p = tlbWriteHit(address, 1);
+        if (!p) return getOrSetValue(false, address, value, BYTE_SIZE) == 0;
+        *p = uint8_t(value);
+        return true;
+    }
+    // size in bytes, 1, 2 or 4
+    bool read(uint32_t address, uint32_t& value, uint32_t size) {
+        return size == 4 ? read32(address, value)
+               : size == 2 ? read16(address, value)
+                           : read8(address, value);
+    }
+    bool write(uint32_t address, uint32_t value, uint32_t size) {
+        return size == 4 ? write32(address, value)
+               : size == 2 ? write16(address, value)
+                           : write8(address, value);
+    }
+
+    // pages allocated so far, PAGE_SIZE bytes each, counting those shared with copies
+    size_t getPageCount() const { return pageCount; }
+    // of those, the ones no copy shares
+    size_t getPrivatePageCount() const;
+
+    // the size and every page that is not all zeros, see Checkpoint.h; load() replaces
+    // everything, size included
+    void save(CheckpointWriter& out) const;
+    int load(CheckpointReader& in);
+    static uint32_t getPageSize() { return PAGE_SIZE; }
+
     int printMemory(uint32_t startAddress, uint32_t endAddress);
     int printMemArray(uint32_t startAddr, uint32_t endAddr, uint32_t entrySize,
                       uint32_t entriesPerRow, std::ostream& out_stream);
@@ -0,0 +1,152 @@
+#include "PipeStateWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+PipeStateWriter::PipeStateWriter()
+    : fd(-1), head(0), tail(0), stopping(false), failed(false) {
+    for (auto& chunk : ring) chunk.used = 0;
+}
+
+PipeStateWriter::~PipeStateWriter() { close(); }
+
+Status PipeStateWriter::open(const string& base_output_name, bool append) {
+    close();
+
+    string fileName = base_output_name + "_pipe_state.out";
+    fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not open pipe state file!");
+        return ERROR;
+    }
+    baseName = base_output_name;
+
+    for (auto& chunk : ring) {
+        chunk.data.resize(CHUNK_SIZE);
+        chunk.used = 0;
+    }
+    head = 0;
+    tail = 0;
+    stopping = false;
+    failed = false;
+    thread = std::thread(&PipeStateWriter::writerLoop, this);
+    return SUCCESS;
+}
+
+Status PipeStateWriter::close() {
+    if (fd < 0) return SUCCESS;
+
+    if (ring[tail % RING_SLOTS].used) publish();
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+
+    ::close(fd);
+    fd = -1;
+    for (auto& chunk : ring) vector<char>().swap(chunk.data);
+    return failed ? ERROR : SUCCESS;
+}
+
+// give the current chunk to the writer thread and wait for the next slot to be free
+void PipeStateWriter::publish() {
+    tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+    {
+        // an empty critical section is enough to not lose the wakeup
+        lock_guard<mutex> lock(wakeMutex);
+    }
+    wake.notify_all();
+
+    if (tail.load(memory_order_relaxed) - head.load(memory_order_acquire) < RING_SLOTS) return;
+    unique_lock<mutex> lock(wakeMutex);
+    wake.wait(lock, [this] {
+        return tail.load(memory_order_relaxed) - head.load(memory_order_acquire) < RING_SLOTS;
+    });
+}
+
+void PipeStateWriter::writerLoop() {
+    for (;;) {
+        uint64_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) {
+            unique_lock<mutex> lock(wakeMutex);
+            wake.wait(lock, [this, h] { return h != tail.load(memory_order_acquire) || stopping; });
+            if (h == tail.load(memory_order_acquire)) return;  // stopping, nothing left
+        }
+
+        Chunk& chunk = ring[h % RING_SLOTS];
+        const char* p = chunk.data.data();
+        size_t left = chunk.used;
+        while (left && !failed) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                TRACE_ERROR(TRACE_PIPELINE, "Could not write pipe state file: " << strerror(errno));
+                failed = true;
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+        chunk.used = 0;
+
+        head.store(h + 1, memory_order_release);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+        }
+        wake.notify_all();
+    }
+}
+
+// " <instr> " padded to 25 columns and closed with '|', what setw(25) << ... << "|" gave
+static inline char* putInstr(char* p, uint32_t instr) {
+    const string& field = disassembleField(instr);
+    memcpy(p, field.data(), field.size());
+    p += field.size();
+    *p++ = '|';
+    return p;
+}
+
+size_t PipeStateWriter::formatLine(const PipeState& state, char* out) {
+    char* p = out;
+
+    // "Cycle: " << setw(8) << cycle << "\t|" << "|"
+    memcpy(p, "Cycle: ", 7);
+    p += 7;
+    char digits[10];
+    int n = 0;
+    uint32_t cycle = state.cycle;
+    do {
+        digits[n++] = '0' + cycle % 10;
+        cycle /= 10;
+    } while (cycle);
+    for (int i = n; i < 8; i++) *p++ = ' ';
+    while (n) *p++ = digits[--n];
+    memcpy(p, "\t||", 3);
+    p += 3;
+
+    p = putInstr(p, state.ifInstr);
+    p = putInstr(p, state.idInstr);
+    p = putInstr(p, state.exInstr);
+    p = putInstr(p, state.memInstr);
+    p = putInstr(p, state.wbInstr);
+    *p++ = '\n';
+    return p - out;
+}
+
+Status PipeStateWriter::write(const PipeState& state) {
+    if (fd < 0) return ERROR;
+
+    Chunk* chunk = &ring[tail.load(memory_order_relaxed) % RING_SLOTS];
+    if (chunk->used + MAX_LINE > CHUNK_SIZE) {
+        publish();
+        chunk = &ring[tail.load(memory_order_relaxed) % RING_SLOTS];
+    }
+    chunk->used += formatLine(state, chunk->data.data() + chunk->used);
+    return failed ? ERROR : SUCCESS;
+}
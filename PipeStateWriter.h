@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utilities.h"
+
+// Writes <base>_pipe_state.out, one line per cycle, in the same format dumpPipeState()
+// always had. The file is opened once; lines are formatted straight into large chunks,
+// and full chunks are passed through a single-producer/single-consumer ring to a
+// background thread that does the write() calls.
+class PipeStateWriter {
+   public:
+    PipeStateWriter();
+    ~PipeStateWriter();
+    PipeStateWriter(const PipeStateWriter&) = delete;
+    PipeStateWriter& operator=(const PipeStateWriter&) = delete;
+
+    // truncates the file unless append is set; closes whatever was open before
+    Status open(const std::string& base_output_name, bool append = false);
+    Status write(const PipeState& state);
+    // hands over what is left, waits for the writer thread and closes the file
+    Status close();
+
+    bool isOpen() const { return fd >= 0; }
+    const std::string& getBaseName() const { return baseName; }
+
+    static const size_t MAX_LINE = 512;  // well above the longest disassembly x5
+
+    // formats one line, newline included, into out (MAX_LINE bytes); returns its length
+    static size_t formatLine(const PipeState& state, char* out);
+
+   private:
+    static const size_t CHUNK_SIZE = 1 << 20;
+    static const size_t RING_SLOTS = 4;
+
+    struct Chunk {
+        std::vector<char> data;
+        size_t used;
+    };
+
+    void publish();
+    void writerLoop();
+
+    int fd;
+    std::string baseName;
+
+    // ring[tail % RING_SLOTS] belongs to the simulator thread, ring[head..tail) to the
+    // writer thread
+    Chunk ring[RING_SLOTS];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<bool> stopping;
+    std::atomic<bool> failed;
+
+    // only used to sleep when the ring is empty (writer) or full (simulator)
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread thread;
+};
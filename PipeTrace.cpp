@@ -0,0 +1,274 @@
+#include "PipeTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum SlotCode { SLOT_SAME = 0, SLOT_SHIFTED = 1, SLOT_DICT = 2, SLOT_LITERAL = 3 };
+
+static const uint16_t RECORD_MARKER = 0x8000;
+static const uint16_t EXPLICIT_CYCLE = 0x4000;
+static const size_t HEADER_SIZE = 16;
+
+static inline void getSlots(const PipeState& state, uint32_t slots[5]) {
+    slots[0] = state.ifInstr;
+    slots[1] = state.idInstr;
+    slots[2] = state.exInstr;
+    slots[3] = state.memInstr;
+    slots[4] = state.wbInstr;
+}
+
+static inline void setSlots(PipeState& state, const uint32_t slots[5]) {
+    state.ifInstr = slots[0];
+    state.idInstr = slots[1];
+    state.exInstr = slots[2];
+    state.memInstr = slots[3];
+    state.wbInstr = slots[4];
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *p++ = uint8_t(value);
+    return p;
+}
+
+PipeTraceWriter::PipeTraceWriter() : fd(-1), window(nullptr), windowOffset(0), size(0) {}
+
+PipeTraceWriter::~PipeTraceWriter() { close(); }
+
+Status PipeTraceWriter::open(const string& base_output_name) {
+    close();
+
+    string fileName = base_output_name + "_pipe_trace.bin";
+    fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not open pipe trace file " << fileName);
+        return ERROR;
+    }
+
+    size = 0;
+    windowOffset = 0;
+    if (remap() != SUCCESS) return ERROR;
+
+    memcpy(window, PIPE_TRACE_MAGIC, 8);
+    uint32_t version = PIPE_TRACE_VERSION;
+    memcpy(window + 8, &version, 4);
+    memset(window + 12, 0, 4);
+    size = HEADER_SIZE;
+
+    // the first record is coded against an empty pipeline one cycle before 0
+    memset(&prev, 0, sizeof(prev));
+    prev.cycle = uint32_t(-1);
+    dictionary.clear();
+    return SUCCESS;
+}
+
+// move the window so that it starts at the page holding the write position and make
+// the file long enough to back all of it
+Status PipeTraceWriter::remap() {
+    if (window) munmap(window, WINDOW_SIZE);
+    window = nullptr;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    windowOffset = size / page * page;
+    if (ftruncate(fd, windowOffset + WINDOW_SIZE) != 0) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not grow pipe trace file: " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return ERROR;
+    }
+    void* p = mmap(nullptr, WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, windowOffset);
+    if (p == MAP_FAILED) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not map pipe trace file: " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return ERROR;
+    }
+    window = static_cast<uint8_t*>(p);
+    return SUCCESS;
+}
+
+Status PipeTraceWriter::write(const PipeState& state) {
+    if (fd < 0) return ERROR;
+    if (size + MAX_RECORD > windowOffset + WINDOW_SIZE && remap() != SUCCESS) return ERROR;
+
+    uint8_t* start = window + (size - windowOffset);
+    uint8_t* p = start + 2;
+    uint16_t header = RECORD_MARKER;
+
+    if (state.cycle != prev.cycle + 1) {
+        header |= EXPLICIT_CYCLE;
+        p = putVarint(p, state.cycle);
+    }
+
+    uint32_t cur[5], old[5];
+    getSlots(state, cur);
+    getSlots(prev, old);
+    for (int i = 0; i < 5; i++) {
+        uint32_t word = cur[i];
+        SlotCode code;
+        if (word == old[i]) {
+            code = SLOT_SAME;
+        } else if (i > 0 && word == old[i - 1]) {
+            code = SLOT_SHIFTED;
+        } else {
+            auto it = dictionary.find(word);
+            if (it != dictionary.end()) {
+                code = SLOT_DICT;
+                p = putVarint(p, it->second);
+            } else {
+                code = SLOT_LITERAL;
+                uint32_t index = dictionary.size();
+                dictionary.emplace(word, index);
+                memcpy(p, &word, 4);  // the file is little endian, like every host we run on
+                p += 4;
+            }
+        }
+        header |= code << (2 * i);
+    }
+    memcpy(start, &header, 2);
+
+    size += p - start;
+    prev = state;
+    return SUCCESS;
+}
+
+Status PipeTraceWriter::close() {
+    if (fd < 0) return SUCCESS;
+
+    Status status = SUCCESS;
+    munmap(window, WINDOW_SIZE);
+    window = nullptr;
+    if (ftruncate(fd, size) != 0) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not trim pipe trace file: " << strerror(errno));
+        status = ERROR;
+    }
+    ::close(fd);
+    fd = -1;
+    dictionary.clear();
+    return status;
+}
+
+PipeTraceReader::PipeTraceReader() : data(nullptr), size(0), pos(0) {}
+
+PipeTraceReader::~PipeTraceReader() { close(); }
+
+Status PipeTraceReader::open(const string& fileName) {
+    close();
+
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        TRACE_ERROR(TRACE_PIPELINE, "Unable to open pipe trace file " << fileName);
+        return ERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+        TRACE_ERROR(TRACE_PIPELINE, fileName << " is not a pipe trace");
+        ::close(fd);
+        return ERROR;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        TRACE_ERROR(TRACE_PIPELINE, "Could not map pipe trace file: " << strerror(errno));
+        return ERROR;
+    }
+    data = static_cast<const uint8_t*>(p);
+    size = st.st_size;
+
+    uint32_t version;
+    memcpy(&version, data + 8, 4);
+    if (memcmp(data, PIPE_TRACE_MAGIC, 8) != 0 || version != PIPE_TRACE_VERSION) {
+        TRACE_ERROR(TRACE_PIPELINE, fileName << " is not a version " << PIPE_TRACE_VERSION
+                                             << " pipe trace");
+        close();
+        return ERROR;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+
+    pos = HEADER_SIZE;
+    memset(&prev, 0, sizeof(prev));
+    prev.cycle = uint32_t(-1);
+    dictionary.clear();
+    return SUCCESS;
+}
+
+void PipeTraceReader::close() {
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+    data = nullptr;
+    size = 0;
+    pos = 0;
+}
+
+bool PipeTraceReader::next(PipeState& state) {
+    if (pos + 2 > size) return false;
+    uint16_t header;
+    memcpy(&header, data + pos, 2);
+    // an unterminated run leaves zeros behind the last record
+    if (!(header & RECORD_MARKER)) return false;
+
+    size_t p = pos + 2;
+    bool truncated = false;
+    auto getVarint = [&]() -> uint32_t {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p >= size) break;
+            uint8_t byte = data[p++];
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        truncated = true;
+        return 0;
+    };
+
+    state.cycle = (header & EXPLICIT_CYCLE) ? getVarint() : prev.cycle + 1;
+
+    uint32_t cur[5], old[5];
+    getSlots(prev, old);
+    for (int i = 0; i < 5 && !truncated; i++) {
+        switch ((header >> (2 * i)) & 3) {
+            case SLOT_SAME:
+                cur[i] = old[i];
+                break;
+            case SLOT_SHIFTED:
+                cur[i] = i > 0 ? old[i - 1] : 0;
+                break;
+            case SLOT_DICT: {
+                uint32_t index = getVarint();
+                if (index >= dictionary.size()) {
+                    truncated = true;
+                    break;
+                }
+                cur[i] = dictionary[index];
+                break;
+            }
+            case SLOT_LITERAL:
+                if (p + 4 > size) {
+                    truncated = true;
+                    break;
+                }
+                memcpy(&cur[i], data + p, 4);
+                p += 4;
+                dictionary.push_back(cur[i]);
+                break;
+        }
+    }
+    if (truncated) {
+        TRACE_ERROR(TRACE_PIPELINE, "Corrupt pipe trace record at offset " << pos);
+        pos = size;
+        return false;
+    }
+
+    setSlots(state, cur);
+    pos = p;
+    prev = state;
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Utilities.h"
+
+// Binary pipeline trace, <base>_pipe_trace.bin, an opt-in replacement for the text
+// _pipe_state.out (pipe_render turns it back into the text).
+//
+// After a 16-byte header ("MIPSPIPE", version, reserved) every cycle is one record:
+//   uint16 (little endian)  bit 15: always set, a zero word marks the end of the data
+//                           bit 14: explicit cycle number follows, otherwise previous + 1
+//                           bits 2i..2i+1: how slot i (if, id, ex, mem, wb) is coded
+//   [varint cycle]
+//   per slot, in order, nothing or its operand:
+//     SLOT_SAME     same word as this slot in the previous record
+//     SLOT_SHIFTED  the word the slot before held in the previous record
+//     SLOT_DICT     varint index into the dictionary
+//     SLOT_LITERAL  uint32 little endian; appended to the dictionary
+// A cycle where the pipeline simply advances costs 3-4 bytes instead of ~140.
+
+#define PIPE_TRACE_MAGIC "MIPSPIPE"
+#define PIPE_TRACE_VERSION 1
+
+class PipeTraceWriter {
+   public:
+    PipeTraceWriter();
+    ~PipeTraceWriter();
+    PipeTraceWriter(const PipeTraceWriter&) = delete;
+    PipeTraceWriter& operator=(const PipeTraceWriter&) = delete;
+
+    Status open(const std::string& base_output_name);
+    Status write(const PipeState& state);
+    // unmaps and trims the file to the bytes actually written
+    Status close();
+
+    bool isOpen() const { return fd >= 0; }
+
+   private:
+    static const size_t WINDOW_SIZE = 16 << 20;  // bytes mapped at a time
+    static const size_t MAX_RECORD = 2 + 5 + 5 * 5;
+
+    Status remap();
+
+    int fd;
+    uint8_t* window;     // mapping of [windowOffset, windowOffset + WINDOW_SIZE)
+    size_t windowOffset;
+    size_t size;         // bytes of trace written so far
+    PipeState prev;
+    std::unordered_map<uint32_t, uint32_t> dictionary;
+};
+
+class PipeTraceReader {
+   public:
+    PipeTraceReader();
+    ~PipeTraceReader();
+    PipeTraceReader(const PipeTraceReader&) = delete;
+    PipeTraceReader& operator=(const PipeTraceReader&) = delete;
+
+    Status open(const std::string& fileName);
+    // false at the end of the trace
+    bool next(PipeState& state);
+    void close();
+
+   private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    PipeState prev;
+    std::vector<uint32_t> dictionary;
+};
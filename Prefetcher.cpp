@@ -0,0 +1,137 @@
+#include "Prefetcher.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+Prefetcher::Prefetcher(const CacheConfig& config)
+    : blockSize(config.blockSize), degree(config.prefetchDegree), distance(config.prefetchDistance) {}
+
+unique_ptr<Prefetcher> Prefetcher::create(const CacheConfig& config) {
+    switch (config.prefetcher) {
+        case PREFETCH_NEXT_LINE:
+            return unique_ptr<Prefetcher>(new NextLinePrefetcher(config));
+        case PREFETCH_STRIDE:
+            return unique_ptr<Prefetcher>(new StridePrefetcher(config));
+        case PREFETCH_STREAM:
+            return unique_ptr<Prefetcher>(new StreamPrefetcher(config));
+        default:
+            return nullptr;
+    }
+}
+
+void NextLinePrefetcher::observe(uint32_t pc, uint32_t address, bool trigger,
+                                 vector<uint32_t>& blocks) {
+    if (!trigger) return;
+    uint32_t block = address & ~(blockSize - 1);
+    for (uint32_t i = 0; i < degree; i++) blocks.push_back(block + (distance + i) * blockSize);
+}
+
+StridePrefetcher::StridePrefetcher(const CacheConfig& config)
+    : Prefetcher(config), table(TABLE_SIZE, Entry{0, 0, 0, 0, false}) {}
+
+void StridePrefetcher::observe(uint32_t pc, uint32_t address, bool trigger,
+                               vector<uint32_t>& blocks) {
+    Entry& e = table[(pc >> 2) % TABLE_SIZE];
+    if (!e.valid || e.pc != pc) {
+        e = Entry{pc, address, 0, 0, true};
+        return;
+    }
+
+    int32_t stride = int32_t(address - e.lastAddress);
+    e.lastAddress = address;
+    if (stride == e.stride) {
+        if (e.confidence < 3) e.confidence++;
+    } else if (e.confidence > 0) {
+        e.confidence--;
+    } else {
+        e.stride = stride;
+        e.confidence = 1;
+    }
+    if (e.confidence < 2 || e.stride == 0) return;
+
+    // strides inside a block walk block by block
+    int32_t step = e.stride;
+    if (uint32_t(abs(step)) < blockSize) step = step < 0 ? -int32_t(blockSize) : blockSize;
+    for (uint32_t i = 0; i < degree; i++) {
+        blocks.push_back((address + step * int32_t(distance + i)) & ~(blockSize - 1));
+    }
+}
+
+StreamPrefetcher::StreamPrefetcher(const CacheConfig& config)
+    : Prefetcher(config), streams(STREAMS, Stream{0, 0, 0, 0, false}), clock(0) {}
+
+void StreamPrefetcher::observe(uint32_t pc, uint32_t address, bool trigger,
+                               vector<uint32_t>& blocks) {
+    if (!trigger) return;
+    uint32_t block = address / blockSize;
+    clock++;
+
+    Stream* match = nullptr;
+    Stream* oldest = &streams[0];
+    for (Stream& s : streams) {
+        if (s.valid && block != s.head && uint32_t(abs(int32_t(block - s.head))) <= WINDOW) {
+            match = &s;
+            break;
+        }
+        if (!s.valid || s.lastUse < oldest->lastUse) oldest = &s;
+    }
+    if (!match) {
+        *oldest = Stream{block, 0, 0, clock, true};
+        return;
+    }
+
+    int32_t direction = block > match->head ? 1 : -1;
+    if (direction != match->direction) {
+        match->direction = direction;
+        match->confirmations = 0;
+    }
+    match->head = block;
+    match->lastUse = clock;
+    if (++match->confirmations < 2) return;
+
+    for (uint32_t i = 0; i < degree; i++) {
+        blocks.push_back((block + direction * int32_t(distance + i)) * blockSize);
+    }
+}
+
+void StridePrefetcher::save(CheckpointWriter& out) const {
+    for (const Entry& e : table) {
+        out.put(e.pc);
+        out.put(e.lastAddress);
+        out.put(e.stride);
+        out.put(e.confidence);
+        out.put(e.valid);
+    }
+}
+
+bool StridePrefetcher::load(CheckpointReader& in) {
+    for (Entry& e : table) {
+        if (!in.get(e.pc) || !in.get(e.lastAddress) || !in.get(e.stride) ||
+            !in.get(e.confidence) || !in.get(e.valid)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StreamPrefetcher::save(CheckpointWriter& out) const {
+    for (const Stream& s : streams) {
+        out.put(s.head);
+        out.put(s.direction);
+        out.put(s.confirmations);
+        out.put(s.lastUse);
+        out.put(s.valid);
+    }
+    out.put(clock);
+}
+
+bool StreamPrefetcher::load(CheckpointReader& in) {
+    for (Stream& s : streams) {
+        if (!in.get(s.head) || !in.get(s.direction) || !in.get(s.confirmations) ||
+            !in.get(s.lastUse) || !in.get(s.valid)) {
+            return false;
+        }
+    }
+    return in.get(clock);
+}
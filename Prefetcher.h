@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "cache.h"
+
+// Decides which blocks an L1 brings in ahead of demand. CacheHierarchy shows it every
+// demand access and fills whatever it asks for that is not cached yet.
+//
+// trigger is set on a miss and on the first use of a prefetched block, so next-line and
+// stream prefetchers keep running ahead of a sequential walk without re-checking every
+// access; the stride prefetcher trains on all accesses.
+class Prefetcher {
+   public:
+    explicit Prefetcher(const CacheConfig& config);
+    virtual ~Prefetcher() {}
+
+    // appends block addresses to prefetch, at most degree of them
+    virtual void observe(uint32_t pc, uint32_t address, bool trigger,
+                         std::vector<uint32_t>& blocks) = 0;
+    // a copy with the same training state
+    virtual std::unique_ptr<Prefetcher> clone() const = 0;
+    // the training state, see Checkpoint.h
+    virtual void save(CheckpointWriter& out) const {}
+    virtual bool load(CheckpointReader& in) { return true; }
+
+    // nullptr for PREFETCH_NONE
+    static std::unique_ptr<Prefetcher> create(const CacheConfig& config);
+
+   protected:
+    uint32_t blockSize;
+    uint32_t degree;
+    uint32_t distance;
+};
+
+// Blocks distance .. distance + degree - 1 after the triggering one.
+class NextLinePrefetcher : public Prefetcher {
+   public:
+    using Prefetcher::Prefetcher;
+    void observe(uint32_t pc, uint32_t address, bool trigger,
+                 std::vector<uint32_t>& blocks) override;
+    std::unique_ptr<Prefetcher> clone() const override {
+        return std::unique_ptr<Prefetcher>(new NextLinePrefetcher(*this));
+    }
+};
+
+// Reference prediction table after Chen and Baer: a direct-mapped table indexed by the
+// PC of the load or store remembers its last address and stride. Once the same stride
+// has been seen twice in a row, the addresses distance .. distance + degree - 1
+// strides ahead are prefetched.
+class StridePrefetcher : public Prefetcher {
+   public:
+    explicit StridePrefetcher(const CacheConfig& config);
+    void observe(uint32_t pc, uint32_t address, bool trigger,
+                 std::vector<uint32_t>& blocks) override;
+    std::unique_ptr<Prefetcher> clone() const override {
+        return std::unique_ptr<Prefetcher>(new StridePrefetcher(*this));
+    }
+    void save(CheckpointWriter& out) const override;
+    bool load(CheckpointReader& in) override;
+
+   private:
+    static const uint32_t TABLE_SIZE = 64;
+    struct Entry {
+        uint32_t pc;
+        uint32_t lastAddress;
+        int32_t stride;
+        uint8_t confidence;  // 0..3, prefetch from 2
+        bool valid;
+    };
+    std::vector<Entry> table;
+};
+
+// Tracks a few streams of missed blocks. A miss next to the head of a stream (within a
+// small window, either direction) extends it; after two such misses it is confirmed and
+// every trigger on it prefetches degree blocks starting distance blocks past its head.
+// Misses that join no stream replace the least recently used one.
+class StreamPrefetcher : public Prefetcher {
+   public:
+    explicit StreamPrefetcher(const CacheConfig& config);
+    void observe(uint32_t pc, uint32_t address, bool trigger,
+                 std::vector<uint32_t>& blocks) override;
+    std::unique_ptr<Prefetcher> clone() const override {
+        return std::unique_ptr<Prefetcher>(new StreamPrefetcher(*this));
+    }
+    void save(CheckpointWriter& out) const override;
+    bool load(CheckpointReader& in) override;
+
+   private:
+    static const uint32_t STREAMS = 16;
+    static const uint32_t WINDOW = 4;  // blocks
+    struct Stream {
+        uint32_t head;  // block number
+        int32_t direction;
+        uint32_t confirmations;
+        uint64_t lastUse;
+        bool valid;
+    };
+    std::vector<Stream> streams;
+    uint64_t clock;
+};
@@ -0,0 +1,125 @@
+#include "ShardedReplay.h"
+
+using namespace std;
+
+static uint32_t log2Floor(uint32_t n) {
+    uint32_t bits = 0;
+    while (n >>= 1) bits++;
+    return bits;
+}
+
+static uint32_t addressOf(uint32_t address) { return address; }
+static uint32_t addressOf(const CacheAccess& access) { return access.address; }
+
+static uint32_t withAddress(uint32_t, uint32_t address) { return address; }
+static CacheAccess withAddress(const CacheAccess& access, uint32_t address) {
+    return CacheAccess{address, access.op};
+}
+
+static bool replay(Cache& cache, uint32_t address) { return cache.access(address, CACHE_READ); }
+static bool replay(Cache& cache, const CacheAccess& access) {
+    return cache.access(access.address, access.op);
+}
+
+// a Cache counts in 32 bits, so the totals are kept here as the accesses go
+template <typename Access>
+static void replayAll(Cache& cache, const vector<Access>& accesses, ReplayStats& stats) {
+    for (const Access& access : accesses) {
+        uint32_t writebacks = cache.getWritebacks();
+        if (replay(cache, access))
+            stats.hits++;
+        else
+            stats.misses++;
+        stats.writebacks += cache.getWritebacks() - writebacks;
+    }
+    stats.writebackBytes = cache.getWritebackBytes();
+}
+
+ShardedReplay::ShardedReplay(const CacheConfig& config, ThreadPool& pool)
+    : config(config), shardConfig(config), pool(pool), shardBits(0) {
+    uint32_t numSets = config.cacheSize / config.ways / config.blockSize;
+    offsetBits = log2Floor(config.blockSize);
+    setBits = log2Floor(numSets);
+    if (pool.size() == 1 || config.policy == REPLACE_RANDOM || config.policy == REPLACE_BRRIP ||
+        (numSets & (numSets - 1)) != 0) {
+        return;
+    }
+
+    // a few shards per worker evens out sets that see more traffic, but every shard keeps
+    // one bit of offset or index for the valid bit
+    uint32_t target = log2Floor(pool.size() * 4 - 1) + 1;
+    shardBits = min(target, setBits);
+    if (shardBits > 0 && offsetBits + setBits - shardBits < 1) shardBits--;
+    shardConfig.cacheSize = config.cacheSize >> shardBits;
+}
+
+ReplayStats ShardedReplay::run(const vector<uint32_t>& addresses) {
+    return isSharded() ? runSharded(addresses) : runSerial(addresses);
+}
+
+ReplayStats ShardedReplay::run(const vector<CacheAccess>& accesses) {
+    return isSharded() ? runSharded(accesses) : runSerial(accesses);
+}
+
+template <typename Access>
+ReplayStats ShardedReplay::runSerial(const vector<Access>& accesses) const {
+    Cache cache(config, D_CACHE);
+    ReplayStats stats{0, 0, 0, 0};
+    replayAll(cache, accesses, stats);
+    return stats;
+}
+
+// tag, then the index without its shard bits, then the offset
+uint32_t ShardedReplay::remap(uint32_t address) const {
+    uint32_t tagShift = offsetBits + setBits;
+    uint32_t low = address & ((1u << offsetBits) - 1);
+    uint32_t index = (address >> offsetBits) & ((1u << setBits) - 1);
+    uint32_t tag = tagShift < 32 ? address >> tagShift : 0;
+    return (tag << (tagShift - shardBits)) | ((index >> shardBits) << offsetBits) | low;
+}
+
+template <typename Access>
+ReplayStats ShardedReplay::runSharded(const vector<Access>& accesses) {
+    uint32_t shards = 1u << shardBits;
+    uint32_t shardMask = shards - 1;
+    size_t chunks = pool.size();
+    size_t chunkSize = (accesses.size() + chunks - 1) / chunks;
+
+    // buckets[chunk][shard], each in stream order
+    vector<vector<vector<Access>>> buckets(chunks, vector<vector<Access>>(shards));
+    for (size_t c = 0; c < chunks; c++) {
+        pool.submit([this, c, chunkSize, shardMask, &accesses, &buckets] {
+            size_t begin = min(accesses.size(), c * chunkSize);
+            size_t end = min(accesses.size(), begin + chunkSize);
+            for (size_t i = begin; i < end; i++) {
+                uint32_t address = addressOf(accesses[i]);
+                uint32_t shard = (address >> offsetBits) & shardMask;
+                buckets[c][shard].push_back(withAddress(accesses[i], remap(address)));
+            }
+        });
+    }
+    pool.wait();
+
+    vector<ReplayStats> results(shards);
+    for (uint32_t s = 0; s < shards; s++) {
+        pool.submit([this, s, &buckets, &results] {
+            Cache cache(shardConfig, D_CACHE);
+            ReplayStats& stats = results[s];
+            stats = ReplayStats{0, 0, 0, 0};
+            for (auto& chunk : buckets) {
+                replayAll(cache, chunk[s], stats);
+                vector<Access>().swap(chunk[s]);
+            }
+        });
+    }
+    pool.wait();
+
+    ReplayStats total{0, 0, 0, 0};
+    for (const ReplayStats& r : results) {
+        total.hits += r.hits;
+        total.misses += r.misses;
+        total.writebacks += r.writebacks;
+        total.writebackBytes += r.writebackBytes;
+    }
+    return total;
+}
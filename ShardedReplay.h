@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+#include "ThreadPool.h"
+#include "cache.h"
+
+struct CacheAccess {
+    uint32_t address;
+    CacheOperation op;
+};
+
+// Totals of a replay, counted in 64 bits as it goes rather than read from the Cache's
+// 32-bit counters.
+struct ReplayStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+    uint64_t writebackBytes;
+};
+
+// Replays an address stream through one Cache geometry on every worker of a pool.
+//
+// Sets never interact, so the stream is split by the low set-index bits into shards,
+// each replayed in order by a Cache of the remaining sets. An address is remapped into
+// its shard by dropping those bits from the index and keeping them out of the tag, which
+// leaves every set seeing the same sequence of blocks as in one big Cache: the totals
+// match a serial run exactly. Splitting is parallel too: every worker buckets one chunk
+// of the stream, and a shard then replays its buckets in chunk order.
+//
+// Random and BRRIP replacement draw from one generator for the whole cache, so their
+// outcome depends on the order across sets; they, caches whose set count is not a
+// power of two, and single-worker pools are replayed serially.
+class ShardedReplay {
+   public:
+    ShardedReplay(const CacheConfig& config, ThreadPool& pool);
+
+    // all reads
+    ReplayStats run(const std::vector<uint32_t>& addresses);
+    ReplayStats run(const std::vector<CacheAccess>& accesses);
+
+    bool isSharded() const { return shardBits > 0; }
+
+   private:
+    template <typename Access>
+    ReplayStats runSerial(const std::vector<Access>& accesses) const;
+    template <typename Access>
+    ReplayStats runSharded(const std::vector<Access>& accesses);
+    uint32_t remap(uint32_t address) const;
+
+    CacheConfig config;
+    CacheConfig shardConfig;
+    ThreadPool& pool;
+    uint32_t offsetBits;
+    uint32_t setBits;
+    uint32_t shardBits;  // 0 when replaying serially
+};
@@ -0,0 +1,80 @@
+#include "StackDistance.h"
+
+#include <cassert>
+#include <unordered_map>
+
+using namespace std;
+
+static uint32_t log2Exact(uint32_t n) {
+    assert(n && (n & (n - 1)) == 0);
+    uint32_t bits = 0;
+    while (n >>= 1) bits++;
+    return bits;
+}
+
+StackDistanceSweep::StackDistanceSweep(uint32_t blockSize, uint32_t maxSets, uint32_t maxWays)
+    : offsetBits(log2Exact(blockSize)), maxSetBits(log2Exact(maxSets)), maxWays(maxWays),
+      accesses(0) {}
+
+void StackDistanceSweep::run(const vector<uint32_t>& addresses) {
+    accesses = addresses.size();
+    histograms.assign(maxSetBits + 1, vector<uint64_t>(maxWays + 1, 0));
+    for (uint32_t setBits = 0; setBits <= maxSetBits; setBits++) {
+        runForSets(addresses, setBits, histograms[setBits]);
+    }
+}
+
+void StackDistanceSweep::runForSets(const vector<uint32_t>& addresses, uint32_t setBits,
+                                    vector<uint64_t>& histogram) {
+    uint32_t numSets = 1u << setBits;
+    uint32_t setMask = numSets - 1;
+
+    // every set gets its own clock and a Fenwick tree over it, sized up front
+    vector<uint32_t> setAccesses(numSets, 0);
+    for (uint32_t address : addresses) setAccesses[(address >> offsetBits) & setMask]++;
+    vector<vector<int32_t>> trees(numSets);
+    for (uint32_t s = 0; s < numSets; s++) trees[s].assign(setAccesses[s] + 1, 0);
+    vector<uint32_t> clock(numSets, 0);
+
+    // a 1 at time t in a set's tree means some block was last touched at t
+    auto add = [](vector<int32_t>& tree, uint32_t t, int32_t delta) {
+        for (t++; t < tree.size(); t += t & -t) tree[t] += delta;
+    };
+    auto prefix = [](const vector<int32_t>& tree, uint32_t t) {  // sum over [0, t)
+        int32_t sum = 0;
+        for (; t; t -= t & -t) sum += tree[t];
+        return sum;
+    };
+
+    unordered_map<uint32_t, uint32_t> lastAccess;  // block -> time in its set
+    lastAccess.reserve(addresses.size() / 4 + 16);
+
+    for (uint32_t address : addresses) {
+        uint32_t block = address >> offsetBits;
+        uint32_t set = block & setMask;
+        vector<int32_t>& tree = trees[set];
+        uint32_t now = clock[set]++;
+
+        auto it = lastAccess.find(block);
+        if (it == lastAccess.end()) {
+            histogram[maxWays]++;
+            lastAccess.emplace(block, now);
+        } else {
+            uint32_t then = it->second;
+            uint32_t distance = prefix(tree, now) - prefix(tree, then + 1);
+            histogram[distance < maxWays ? distance : maxWays]++;
+            add(tree, then, -1);
+            it->second = now;
+        }
+        add(tree, now, 1);
+    }
+}
+
+uint64_t StackDistanceSweep::getHits(uint32_t numSets, uint32_t ways) const {
+    uint32_t setBits = log2Exact(numSets);
+    assert(setBits <= maxSetBits && ways >= 1 && ways <= maxWays);
+
+    uint64_t hits = 0;
+    for (uint32_t d = 0; d < ways; d++) hits += histograms[setBits][d];
+    return hits;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+// All-configurations LRU analysis after Mattson et al., for one block size.
+//
+// run() makes one pass over an address stream for each power-of-two set count up to
+// maxSets, building the histogram of per-set LRU stack distances (how many other blocks
+// of the same set were touched since the last access to this block). A cache with S
+// sets and W ways hits exactly on the accesses whose distance in the S-set histogram is
+// below W, so the hit count of every (sets, ways) geometry falls out of a prefix sum.
+//
+// Distances are counted with one Fenwick tree per set over that set's access times,
+// O(log n) per access and set count. Only meaningful for true LRU with allocation on
+// every miss, which is what Cache does.
+class StackDistanceSweep {
+   public:
+    // blockSize and maxSets must be powers of two
+    StackDistanceSweep(uint32_t blockSize, uint32_t maxSets, uint32_t maxWays);
+
+    void run(const std::vector<uint32_t>& addresses);
+
+    uint64_t getAccesses() const { return accesses; }
+    // numSets a power of two up to maxSets, ways from 1 to maxWays
+    uint64_t getHits(uint32_t numSets, uint32_t ways) const;
+    uint64_t getMisses(uint32_t numSets, uint32_t ways) const {
+        return accesses - getHits(numSets, ways);
+    }
+
+   private:
+    // histogram[i][d] for 2^i sets: accesses at distance d, d == maxWays means further
+    // away or never seen before
+    void runForSets(const std::vector<uint32_t>& addresses, uint32_t setBits,
+                    std::vector<uint64_t>& histogram);
+
+    uint32_t offsetBits;
+    uint32_t maxSetBits;
+    uint32_t maxWays;
+    uint64_t accesses;
+    std::vector<std::vector<uint64_t>> histograms;
+};
@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned workers) : nextQueue(0), pending(0), queued(0), stopping(false) {
+    if (workers == 0) workers = thread::hardware_concurrency();
+    if (workers == 0) workers = 1;
+
+    for (unsigned i = 0; i < workers; i++) queues.emplace_back(new Queue());
+    for (unsigned i = 0; i < workers; i++) threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(idleLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void ThreadPool::submit(function<void()> job) {
+    Queue& q = *queues[nextQueue++ % queues.size()];
+    {
+        lock_guard<mutex> lock(q.lock);
+        q.jobs.push_back(move(job));
+    }
+    {
+        lock_guard<mutex> lock(idleLock);
+        pending++;
+        queued++;
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(idleLock);
+    allDone.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::popOwn(unsigned self, function<void()>& job) {
+    Queue& q = *queues[self];
+    lock_guard<mutex> lock(q.lock);
+    if (q.jobs.empty()) return false;
+    job = move(q.jobs.back());
+    q.jobs.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned self, function<void()>& job) {
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue& q = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> lock(q.lock);
+        if (q.jobs.empty()) continue;
+        job = move(q.jobs.front());
+        q.jobs.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+    for (;;) {
+        {
+            unique_lock<mutex> lock(idleLock);
+            workAvailable.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0) return;  // stopping and nothing left
+            queued--;
+        }
+
+        // jobs are queued before they are counted, so holding a count guarantees there
+        // is a job in some deque for us
+        function<void()> job;
+        while (!popOwn(self, job) && !steal(self, job)) this_thread::yield();
+        job();
+
+        {
+            lock_guard<mutex> lock(idleLock);
+            if (--pending == 0) allDone.notify_all();
+        }
+    }
+}
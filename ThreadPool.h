@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker has its own deque: it takes jobs from the
+// back of its own and, once that runs dry, steals from the front of the others'.
+// submit() deals jobs out round robin; wait() blocks until all of them have run.
+class ThreadPool {
+   public:
+    // 0 means one worker per hardware thread
+    explicit ThreadPool(unsigned workers = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job);
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+   private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    bool popOwn(unsigned self, std::function<void()>& job);
+    bool steal(unsigned self, std::function<void()>& job);
+    void workerLoop(unsigned self);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> nextQueue;
+
+    // counts jobs submitted but not finished; guarded by idleLock for the waits
+    std::mutex idleLock;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    size_t pending;
+    size_t queued;
+    bool stopping;
+};
@@ -0,0 +1,81 @@
+#include "Trace.h"
+
+#include <unistd.h>
+
+#include <streambuf>
+
+namespace {
+
+// Fixed-size buffer in front of a file descriptor, written out when full, on
+// traceFlush() and at exit.
+class TraceSink : public std::streambuf {
+   public:
+    explicit TraceSink(int fd) : fd(fd) { setp(buffer, buffer + sizeof(buffer)); }
+    ~TraceSink() { sync(); }
+
+   protected:
+    int overflow(int c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (c != traits_type::eof()) {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const char* p = pbase();
+        while (p < pptr()) {
+            ssize_t n = write(fd, p, pptr() - p);
+            if (n <= 0) break;
+            p += n;
+        }
+        setp(buffer, buffer + sizeof(buffer));
+        return 0;
+    }
+
+   private:
+    int fd;
+    char buffer[1 << 16];
+};
+
+std::mutex traceMutex;
+TraceSink outSink(STDOUT_FILENO);
+TraceSink errSink(STDERR_FILENO);
+std::ostream outStream(&outSink);
+std::ostream errStream(&errSink);
+
+const char* levelName(int level) {
+    switch (level) {
+        case TRACE_LEVEL_ERROR:
+            return "[ERROR]";
+        case TRACE_LEVEL_INFO:
+            return "[INFO]";
+        case TRACE_LEVEL_DEBUG:
+            return "[DEBUG]";
+        default:
+            return "[TRACE]";
+    }
+}
+
+}  // namespace
+
+TraceLine::TraceLine(int level, const char* file, int line)
+    : lock(traceMutex), out(level == TRACE_LEVEL_ERROR ? errStream : outStream), level(level) {
+    // formatting flags would otherwise leak from one message into the next
+    out.flags(std::ios_base::dec | std::ios_base::skipws);
+    out.fill(' ');
+    out << levelName(level) << " (" << file << ":" << line << "): ";
+}
+
+TraceLine::~TraceLine() {
+    out << '\n';
+    // errors are rare and usually right before things go wrong, get them out now
+    if (level == TRACE_LEVEL_ERROR) out.flush();
+}
+
+void traceFlush() {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    outStream.flush();
+    errStream.flush();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <mutex>
+#include <ostream>
+
+// Diagnostics with compile-time levels and per-module categories.
+//
+//   TRACE_ERROR(TRACE_MEMORY, "Access violation at address 0x" << hex << address);
+//   TRACE_DEBUG(TRACE_PIPELINE, "load-op detected");
+//
+// Anything above TRACE_LEVEL or outside TRACE_CATEGORIES is dropped at compile time,
+// message arguments included. Pick them on the command line, e.g.
+//   make CFLAGS+="-DTRACE_LEVEL=TRACE_LEVEL_TRACE -DTRACE_CATEGORIES=TRACE_PIPELINE"
+// Errors go to stderr, everything else to a buffered stdout sink that is flushed in
+// large chunks and at exit.
+
+#define TRACE_LEVEL_OFF   0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_INFO  2
+#define TRACE_LEVEL_DEBUG 3
+#define TRACE_LEVEL_TRACE 4
+
+#ifndef TRACE_LEVEL
+#ifdef DEBUG
+#define TRACE_LEVEL TRACE_LEVEL_DEBUG
+#else
+#define TRACE_LEVEL TRACE_LEVEL_ERROR
+#endif
+#endif
+
+#define TRACE_EMULATOR 0x01
+#define TRACE_PIPELINE 0x02
+#define TRACE_CACHE    0x04
+#define TRACE_MEMORY   0x08
+#define TRACE_SIM      0x10  // drivers and output files
+#define TRACE_ALL      0xff
+
+#ifndef TRACE_CATEGORIES
+#define TRACE_CATEGORIES TRACE_ALL
+#endif
+
+#define TRACE_ENABLED(level, category) \
+    ((level) <= TRACE_LEVEL && ((category) & (TRACE_CATEGORIES)) != 0)
+
+#define TRACE(level, category, msg)                                          \
+    do {                                                                     \
+        if (TRACE_ENABLED(level, category)) {                                \
+            TraceLine(level, __FILE__, __LINE__).stream() << msg;            \
+        }                                                                    \
+    } while (0)
+
+#define TRACE_ERROR(category, msg) TRACE(TRACE_LEVEL_ERROR, category, msg)
+#define TRACE_INFO(category, msg)  TRACE(TRACE_LEVEL_INFO, category, msg)
+#define TRACE_DEBUG(category, msg) TRACE(TRACE_LEVEL_DEBUG, category, msg)
+#define TRACE_TRACE(category, msg) TRACE(TRACE_LEVEL_TRACE, category, msg)
+
+// One message. Holds the sink for the whole line so threads don't interleave, writes
+// the "[LEVEL] (file:line): " prefix up front and the newline when it goes away.
+class TraceLine {
+   public:
+    TraceLine(int level, const char* file, int line);
+    ~TraceLine();
+    std::ostream& stream() { return out; }
+
+   private:
+    std::lock_guard<std::mutex> lock;
+    std::ostream& out;
+    int level;
+};
+
+// write out anything still sitting in the trace buffers
+void traceFlush();
@@ -4,10 +4,13 @@
 #include <errno.h>
 #include <inttypes.h>
 
+#include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <vector>
+
+#include "PipeStateWriter.h"
 
 #define NUM_REGS 32
 
@@ -97,7 +100,13 @@ static string getFunString(uint8_t funct) {
     }
 }
 
-static void handleOpZeroInst(uint32_t instr, ostream &out_stream) {
+static void appendHex(string &out, uint32_t value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", value);
+    out += buf;
+}
+
+static void handleOpZeroInst(uint32_t instr, string &sb) {
     uint8_t rs = (instr >> 21) & 0x1f;
     uint8_t rt = (instr >> 16) & 0x1f;
     uint8_t rd = (instr >> 11) & 0x1f;
@@ -106,23 +115,19 @@ static void handleOpZeroInst(uint32_t instr, ostream &out_stream) {
 
     string funName = getFunString(funct);
 
-    ostringstream sb;
-
     if (funct == FUN_JR) {
-        sb << " " << funName << " " << regNames[rs] << " ";
+        sb += " " + funName + " " + regNames[rs] + " ";
     } else if (funct == FUN_SLL || funct == FUN_SRL) {
         if (instr == 0x0) {
-            sb << " nop ";
+            sb += " nop ";
         } else {
-            sb << " " << funName << " " << regNames[rd] << ", " << regNames[rt] << ", "
-               << static_cast<uint32_t>(shamt) << " ";
+            sb += " " + funName + " " + regNames[rd] + ", " + regNames[rt] + ", " +
+                  to_string(shamt) + " ";
         }
     } else {
-        sb << " " << funName << " " << regNames[rd] << ", " << regNames[rs] << ", " << regNames[rt]
-           << " ";
+        sb += " " + funName + " " + regNames[rd] + ", " + regNames[rs] + ", " + regNames[rt] +
+              " ";
     }
-
-    out_stream << left << setw(25) << sb.str();
 }
 
 static string getImmString(uint8_t opcode) {
@@ -171,7 +176,7 @@ static string getImmString(uint8_t opcode) {
     }
 }
 
-static void handleImmInst(uint32_t instr, ostream &out_stream) {
+static void handleImmInst(uint32_t instr, string &sb) {
     uint8_t opcode = (instr >> 26) & 0x3f;
     uint8_t rs = (instr >> 21) & 0x1f;
     uint8_t rt = (instr >> 16) & 0x1f;
@@ -179,8 +184,6 @@ static void handleImmInst(uint32_t instr, ostream &out_stream) {
 
     string opString = getImmString(opcode);
 
-    ostringstream sb;
-
     switch (opcode) {
         case OP_ADDI:
         case OP_ADDIU:
@@ -188,13 +191,15 @@ static void handleImmInst(uint32_t instr, ostream &out_stream) {
         case OP_ORI:
         case OP_SLTI:
         case OP_SLTIU:
-            sb << " " << opString << " " << regNames[rt] << ", " << regNames[rs] << ", " << hex
-               << "0x" << static_cast<uint32_t>(imm) << " ";
+            sb += " " + opString + " " + regNames[rt] + ", " + regNames[rs] + ", ";
+            appendHex(sb, imm);
+            sb += " ";
             break;
         case OP_BEQ:
         case OP_BNE:
-            sb << " " << opString << " " << regNames[rs] << ", " << regNames[rt] << ", " << hex
-               << "0x" << static_cast<uint32_t>(imm) << " ";
+            sb += " " + opString + " " + regNames[rs] + ", " + regNames[rt] + ", ";
+            appendHex(sb, imm);
+            sb += " ";
             break;
         case OP_LBU:
         case OP_LHU:
@@ -204,58 +209,57 @@ static void handleImmInst(uint32_t instr, ostream &out_stream) {
         case OP_SC:
         case OP_SH:
         case OP_SW:
-            sb << " " << opString << " " << regNames[rt] << ", " << static_cast<int16_t>(imm) << "("
-               << regNames[rs] << ") ";
+            sb += " " + opString + " " + regNames[rt] + ", " + to_string(int16_t(imm)) + "(" +
+                  regNames[rs] + ") ";
             break;
         case OP_LUI:
-            sb << " " << opString << " " << regNames[rt] << ", " << hex << "0x"
-               << static_cast<uint32_t>(imm) << " ";
+            sb += " " + opString + " " + regNames[rt] + ", ";
+            appendHex(sb, imm);
+            sb += " ";
             break;
         case OP_BLEZ:
         case OP_BGTZ:
-            sb << " " << opString << " " << regNames[rs] << ", " << hex << "0x"
-               << static_cast<uint32_t>(imm) << " ";
+            sb += " " + opString + " " + regNames[rs] + ", ";
+            appendHex(sb, imm);
+            sb += " ";
             break;
         default:
             // This should never happen.
-            sb << "ILLEGAL";
+            sb += "ILLEGAL";
             break;
     }
-
-    out_stream << left << setw(25) << sb.str();
 }
 
-static void handleJInst(uint32_t instr, ostream &out_stream) {
+static void handleJInst(uint32_t instr, string &sb) {
     uint8_t opcode = (instr >> 26) & 0x3f;
     uint32_t addr = instr & 0x3ffffff;
 
-    ostringstream sb;
-
     switch (opcode) {
         case OP_JAL:
-            sb << " jal " << hex << "0x" << addr << " ";
+            sb += " jal ";
+            appendHex(sb, addr);
+            sb += " ";
             break;
         case OP_J:
-            sb << " j " << hex << "0x" << addr << " ";
+            sb += " j ";
+            appendHex(sb, addr);
+            sb += " ";
             break;
     }
-
-    out_stream << left << setw(25) << sb.str();
 }
 
-static void printInstr(uint32_t curInst, ostream &pipeState) {
+string disassembleInstr(uint32_t curInst) {
     if (curInst == 0xfeedfeed) {
-        pipeState << left << setw(25) << " HALT ";
-        return;
+        return " HALT ";
     } else if (curInst == 0xdeefdeef) {
-        pipeState << left << setw(25) << " UNKNOWN ";
-        return;
+        return " UNKNOWN ";
     }
 
+    string sb;
     switch (getOpcode(curInst)) {
         // Everything with a zero opcode...
         case OP_ZERO:
-            handleOpZeroInst(curInst, pipeState);
+            handleOpZeroInst(curInst, sb);
             break;
         case OP_ADDI:
         case OP_ADDIU:
@@ -276,46 +280,63 @@ static void printInstr(uint32_t curInst, ostream &pipeState) {
         case OP_SW:
         case OP_BLEZ:
         case OP_BGTZ:
-            handleImmInst(curInst, pipeState);
+            handleImmInst(curInst, sb);
             break;
         case OP_J:
         case OP_JAL:
-            handleJInst(curInst, pipeState);
+            handleJInst(curInst, sb);
             break;
         default:
             // Illegal instruction. Trigger an exception.
             // Note: Since we catch illegal instructions here, the "handle"
             // instructions don't need to check for illegal instructions.
             // except for the case with a 0 opcode and illegal function.
-            pipeState << left << setw(25) << " ILLEGAL ";
+            sb = " ILLEGAL ";
     }
+    return sb;
+}
+
+const char *statusName(Status status) {
+    static const char *const STATUS_NAMES[] = {"SUCCESS", "ERROR", "HALT"};
+    return STATUS_NAMES[status];
+}
+
+const string &disassembleField(uint32_t instr) {
+    // direct-mapped by a hash of the word: a run only ever sees a few hundred distinct
+    // words, and a long one that sees more just disassembles a colliding word again
+    struct Entry {
+        uint32_t instr;
+        string field;  // empty until filled
+    };
+    static const uint32_t TABLE_BITS = 12;
+    thread_local vector<Entry> fields(1u << TABLE_BITS);
+    Entry &entry = fields[(instr * 0x9e3779b1u) >> (32 - TABLE_BITS)];
+    if (entry.instr == instr && !entry.field.empty()) return entry.field;
+
+    entry.instr = instr;
+    entry.field = disassembleInstr(instr);
+    if (entry.field.size() < 25) entry.field.append(25 - entry.field.size(), ' ');
+    return entry.field;
 }
 
+// Appends one line to <base>_pipe_state.out, truncating the file on the first call for
+// it. Opens the file on every call; whole runs should keep a PipeStateWriter open instead.
 Status dumpPipeState(PipeState &state, const std::string &base_output_name) {
-    static auto fileInit = false;
+    static string openedName;
+    string fileName = base_output_name + "_pipe_state.out";
     auto fileOp = ios::app;
-    if (!fileInit) {
+    if (fileName != openedName) {
         fileOp = ios::out;
-        fileInit = true;
+        openedName = fileName;
     }
-    ofstream pipe_out(base_output_name + "_pipe_state.out", fileOp);
+    ofstream pipe_out(fileName, fileOp);
 
     if (pipe_out) {
-        pipe_out << "Cycle: " << std::setw(8) << state.cycle << "\t|";
-        pipe_out << "|";
-        printInstr(state.ifInstr, pipe_out);
-        pipe_out << "|";
-        printInstr(state.idInstr, pipe_out);
-        pipe_out << "|";
-        printInstr(state.exInstr, pipe_out);
-        pipe_out << "|";
-        printInstr(state.memInstr, pipe_out);
-        pipe_out << "|";
-        printInstr(state.wbInstr, pipe_out);
-        pipe_out << "|" << endl;
+        char line[PipeStateWriter::MAX_LINE];
+        pipe_out.write(line, PipeStateWriter::formatLine(state, line));
         return SUCCESS;
     } else {
-        cerr << LOG_ERROR << "Could not open pipe state file!" << endl;
+        TRACE_ERROR(TRACE_PIPELINE, "Could not open pipe state file!");
         return ERROR;
     }
 }
@@ -330,10 +351,22 @@ Status dumpSimStats(SimulationStats &stats, const std::string &base_output_name)
         simStats << left << setw(23) << "I-cache misses: "      << stats .icMisses << endl;
         simStats << left << setw(23) << "D-cache hits: "        << stats .dcHits << endl;
         simStats << left << setw(23) << "D-cache misses: "      << stats .dcMisses << endl;
+        simStats << left << setw(23) << "L2 hits: "             << stats .l2Hits << endl;
+        simStats << left << setw(23) << "L2 misses: "           << stats .l2Misses << endl;
+        simStats << left << setw(23) << "L3 hits: "             << stats .l3Hits << endl;
+        simStats << left << setw(23) << "L3 misses: "           << stats .l3Misses << endl;
         simStats << left << setw(23) << "Load-use stalls: "     << stats .loadUseStalls << endl;
+        simStats << left << setw(23) << "Writebacks: "          << stats .writebacks << endl;
+        simStats << left << setw(23) << "Writeback bytes: "     << stats .writebackBytes << endl;
+        simStats << left << setw(23) << "I-cache prefetches: "  << stats .icPrefetches << endl;
+        simStats << left << setw(23) << "I-prefetches useful: " << stats .icPrefetchesUseful << endl;
+        simStats << left << setw(23) << "I-prefetches late: "   << stats .icPrefetchesLate << endl;
+        simStats << left << setw(23) << "D-cache prefetches: "  << stats .dcPrefetches << endl;
+        simStats << left << setw(23) << "D-prefetches useful: " << stats .dcPrefetchesUseful << endl;
+        simStats << left << setw(23) << "D-prefetches late: "   << stats .dcPrefetchesLate << endl;
         return SUCCESS;
     } else {
-        cerr << LOG_ERROR << "Could not open sim stats file!" << endl;
+        TRACE_ERROR(TRACE_SIM, "Could not open sim stats file!");
         return ERROR;
     }
 }
@@ -8,18 +8,18 @@
 #include <iostream>
 #include <string>
 
-// Utilities macro, they are very useful for debugging
-// Check sim_cycle.cpp to see how to use them!
-#define LOG_INFO \
-    "[INFO] (" << __FILE__ << ":" << __LINE__ << "): "
-#define LOG_ERROR \
-    "[ERROR] (" << __FILE__ << ":" << __LINE__ << "): "
+#include "Trace.h"
+
+// Prints "name: value ", handy inside TRACE_* messages (see Trace.h)
 #define LOG_VAR(var) \
     #var << ": " << var << " "
 
 
 enum Status { SUCCESS = 0, ERROR = 1, HALT = 2 };
 
+// "SUCCESS", "ERROR" or "HALT"
+const char* statusName(Status status);
+
 struct PipeState {
     uint32_t cycle;
     uint32_t ifInstr;
@@ -37,12 +37,33 @@ struct SimulationStats {
     uint32_t dcHits;
     uint32_t dcMisses;
     uint32_t loadUseStalls;
+    // 0 when the level is not configured
+    uint32_t l2Hits;
+    uint32_t l2Misses;
+    uint32_t l3Hits;
+    uint32_t l3Misses;
+    // D-cache stores to the next level: dirty lines evicted, or stores written through
+    uint32_t writebacks;
+    uint64_t writebackBytes;
+    // blocks each L1 prefetcher brought in, those later hit by demand, and those hit too early
+    uint32_t icPrefetches;
+    uint32_t icPrefetchesUseful;
+    uint32_t icPrefetchesLate;
+    uint32_t dcPrefetches;
+    uint32_t dcPrefetchesUseful;
+    uint32_t dcPrefetchesLate;
 };
 
 // Implemented in UtilityFunctions.o
 Status dumpPipeState(PipeState& state, const std::string& base_output_name);
 Status dumpSimStats(SimulationStats& stats, const std::string& base_output_name);
 
+// " add $t0, $t1, $t2 " style text used for the pipe state columns
+std::string disassembleInstr(uint32_t instr);
+// the same text left-aligned in a 25 wide column, memoized per instruction word in a
+// fixed-size table per thread; the reference stays valid until the thread's next call
+const std::string& disassembleField(uint32_t instr);
+
 // Endian Helpers
 inline uint32_t ConvertWordToBigEndian(uint32_t value) { return htonl(value); }
 inline uint16_t ConvertHalfWordToBigEndian(uint16_t value) { return htons(value); }
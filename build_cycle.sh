@@ -5,6 +5,6 @@ then
   touch sim_cycle
 fi
 
-g++ -o sim_cycle sim_cycle.cpp cycle.cpp cache.cpp emulator.cpp MemoryStore.cpp Utilities.cpp
+g++ -pthread -o sim_cycle sim_cycle.cpp cycle.cpp cache.cpp CacheHierarchy.cpp Prefetcher.cpp emulator.cpp threaded.cpp jit.cpp MemoryStore.cpp ElfLoader.cpp Checkpoint.cpp Utilities.cpp Trace.cpp PipeStateWriter.cpp PipeTrace.cpp
 chmod +rwx sim_cycle
 echo "note: sim_cycle <file.bin> <cache_config.txt>"
\ No newline at end of file
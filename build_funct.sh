@@ -5,6 +5,6 @@ then
   touch sim_funct
 fi
 
-g++ -o sim_funct sim_funct.cpp funct.cpp emulator.cpp MemoryStore.cpp Utilities.cpp
+g++ -pthread -o sim_funct sim_funct.cpp funct.cpp AccessTrace.cpp emulator.cpp threaded.cpp jit.cpp MemoryStore.cpp ElfLoader.cpp Checkpoint.cpp Utilities.cpp Trace.cpp PipeStateWriter.cpp
 chmod +rwx sim_funct
 echo "note: sim_funct <file.bin>"
\ No newline at end of file
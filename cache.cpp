@@ -5,130 +5,443 @@
  * Jackie Liu, Kevin Wang, Jack Zhang, Siddharth Vetrivel
 */
 
-// Sample cache implementation with random hit return
-
 #include "cache.h"
 
 #include <cassert>
 #include <fstream>
+#include <cstring>
 #include <iostream>
-#include <random>
-#include <cmath>
+#include <new>
+#include <sstream>
 
+#include "Checkpoint.h"
 #include "Utilities.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(CACHE_SCALAR)
+#define CACHE_SIMD 1
+#include <immintrin.h>
+#else
+#define CACHE_SIMD 0
+#endif
+
 using namespace std;
 
-/** TODO[student] change this file to implement your cache */
+// Counts Bits given power of two, n
+static uint32_t countBitsForPowerOfTwo(uint32_t n) {
+    uint32_t count = 0;
+    while (n > 1) {
+        n = n >> 1;
+        count++;
+    }
+    return count;
+}
+
+template <typename T>
+static T* allocateLines(size_t count) {
+    void* p = nullptr;
+    size_t bytes = (count * sizeof(T) + 63) & ~size_t(63);
+    if (posix_memalign(&p, 64, bytes ? bytes : 64) != 0) throw std::bad_alloc();
+    memset(p, 0, bytes);
+    return static_cast<T*>(p);
+}
 
-// Random generator for cache hit/miss simulation
-static std::mt19937 generator(42);  // Fixed seed for deterministic results
-std::uniform_real_distribution<double> distribution(0.0, 1.0);
+template <typename T>
+static T* copyLines(const T* lines, size_t count) {
+    T* p = allocateLines<T>(count);
+    memcpy(p, lines, count * sizeof(T));
+    return p;
+}
 
-// Constructor definition
-Cache::Cache(CacheConfig configParam, CacheDataType cacheType) : hits(0), misses(0), config(configParam) {
-    numSets = config.cacheSize / config.ways / config.blockSize;
+// Tag search: the way of a set holding tag, or -1.
+
+static int findWayScalar(const uint32_t* setTags, uint32_t ways, uint32_t tag) {
+    for (uint32_t i = 0; i < ways; i++) {
+        if (setTags[i] == tag) return i;
+    }
+    return -1;
+}
+
+// LRU aging: makes way the most recent. Empty ways have order 0, so "valid and more
+// recent than way" is 0 < order < order[way].
+
+static void touchLruScalar(uint16_t* setOrder, uint32_t ways, uint32_t way) {
+    uint16_t age = setOrder[way];
+    for (uint32_t j = 0; j < ways; j++) {
+        if (setOrder[j] && setOrder[j] < age) setOrder[j]++;
+    }
+    setOrder[way] = 1;
+}
+
+#if CACHE_SIMD
+// the vector paths run over the whole stride, a multiple of 8 ways; ages stay below
+// 0x8000 so signed 16-bit compares are safe
 
-    tags.resize(numSets);
-    for (auto &row : tags) {
-        row.resize(config.ways);
+static int findWaySse2(const uint32_t* setTags, uint32_t stride, uint32_t tag) {
+    const __m128i probe = _mm_set1_epi32(tag);
+    for (uint32_t i = 0; i < stride; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(setTags + i)), probe);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask) return i + __builtin_ctz(mask);
     }
+    return -1;
+}
 
-    order.resize(numSets);
-    for (auto &row : order) {
-        row.resize(config.ways);
+static void touchLruSse2(uint16_t* setOrder, uint32_t stride, uint32_t way) {
+    const __m128i age = _mm_set1_epi16(setOrder[way]);
+    const __m128i zero = _mm_setzero_si128();
+    for (uint32_t j = 0; j < stride; j += 8) {
+        __m128i* p = (__m128i*)(setOrder + j);
+        __m128i o = _mm_load_si128(p);
+        __m128i older = _mm_and_si128(_mm_cmpgt_epi16(age, o), _mm_cmpgt_epi16(o, zero));
+        _mm_store_si128(p, _mm_sub_epi16(o, older));  // older lanes are -1
     }
+    setOrder[way] = 1;
+}
 
-    valid.resize(numSets);
-    for (auto &row : valid) {
-        row.resize(config.ways, false);
+__attribute__((target("avx2"))) static int findWayAvx2(const uint32_t* setTags, uint32_t stride,
+                                                       uint32_t tag) {
+    const __m256i probe = _mm256_set1_epi32(tag);
+    for (uint32_t i = 0; i < stride; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)(setTags + i)), probe);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask) return i + __builtin_ctz(mask);
     }
+    return -1;
+}
 
-    // Here you can initialize other cache-specific attributes
-    // For instance, if you had cache tables or other structures, initialize them here
+__attribute__((target("avx2"))) static void touchLruAvx2(uint16_t* setOrder, uint32_t stride,
+                                                         uint32_t way) {
+    if (stride == 8) {
+        touchLruSse2(setOrder, stride, way);
+        return;
+    }
+    const __m256i age = _mm256_set1_epi16(setOrder[way]);
+    const __m256i zero = _mm256_setzero_si256();
+    for (uint32_t j = 0; j < stride; j += 16) {
+        __m256i* p = (__m256i*)(setOrder + j);
+        __m256i o = _mm256_load_si256(p);
+        __m256i older = _mm256_and_si256(_mm256_cmpgt_epi16(age, o), _mm256_cmpgt_epi16(o, zero));
+        _mm256_store_si256(p, _mm256_sub_epi16(o, older));
+    }
+    setOrder[way] = 1;
 }
+#endif
 
-// Counts Bits given power of two, n
-int countBitsForPowerOfTwo(uint32_t n) {
-    int count = 0;
-    while (n > 1) {
-        n = n >> 1;
-        count++;
+int Cache::findWay(const uint32_t* setTags, uint32_t tag) const {
+    switch (tagSearch) {
+#if CACHE_SIMD
+        case TAG_SEARCH_AVX2:
+            return findWayAvx2(setTags, setStride, tag);
+        case TAG_SEARCH_SSE2:
+            return findWaySse2(setTags, setStride, tag);
+#endif
+        default:
+            return findWayScalar(setTags, config.ways, tag);
     }
-    return count;
 }
 
-// Access method definition
-bool Cache::access(uint32_t address, CacheOperation readWrite) {
-    uint32_t numBlockOffsetBits = countBitsForPowerOfTwo(config.blockSize);
+// order[way]: 1 for the most recent way up to ways for the least, 0 when empty.
+struct Cache::LruPolicy {
+    static void hit(Cache& cache, const CacheSet& set, uint32_t way) {
+        switch (cache.tagSearch) {
+#if CACHE_SIMD
+            case TAG_SEARCH_AVX2:
+                touchLruAvx2(set.order, cache.setStride, way);
+                return;
+            case TAG_SEARCH_SSE2:
+                touchLruSse2(set.order, cache.setStride, way);
+                return;
+#endif
+            default:
+                touchLruScalar(set.order, cache.config.ways, way);
+        }
+    }
+    static void fill(Cache& cache, const CacheSet& set, uint32_t way) {
+        if (set.order[way]) {
+            // the victim is the oldest, so everything else ages by one
+            hit(cache, set, way);
+            return;
+        }
+        for (uint32_t j = 0; j < cache.config.ways; j++) {
+            if (set.order[j]) set.order[j]++;
+        }
+        set.order[way] = 1;
+    }
+    static uint32_t victim(Cache& cache, const CacheSet& set) {
+        uint32_t way = 0;
+        while (set.order[way] != cache.config.ways) way++;
+        return way;
+    }
+};
+
+// A binary tree over the ways with ways - 1 nodes, node 1 the root and node n's
+// children 2n and 2n + 1, bit n kept in bit n % 16 of order[n / 16]. A node's bit
+// points to the half that was used less recently.
+struct Cache::TreePlruPolicy {
+    static bool get(const CacheSet& set, uint32_t node) {
+        return (set.order[node >> 4] >> (node & 15)) & 1;
+    }
+    static void put(const CacheSet& set, uint32_t node, bool bit) {
+        uint16_t mask = 1u << (node & 15);
+        set.order[node >> 4] = bit ? set.order[node >> 4] | mask : set.order[node >> 4] & ~mask;
+    }
+    static void hit(Cache& cache, const CacheSet& set, uint32_t way) {
+        uint32_t levels = countBitsForPowerOfTwo(cache.config.ways);
+        uint32_t node = 1;
+        for (uint32_t level = levels; level-- > 0;) {
+            bool right = (way >> level) & 1;
+            put(set, node, !right);
+            node = node * 2 + right;
+        }
+    }
+    static void fill(Cache& cache, const CacheSet& set, uint32_t way) { hit(cache, set, way); }
+    static uint32_t victim(Cache& cache, const CacheSet& set) {
+        uint32_t levels = countBitsForPowerOfTwo(cache.config.ways);
+        uint32_t node = 1, way = 0;
+        for (uint32_t level = 0; level < levels; level++) {
+            bool right = get(set, node);
+            way = way * 2 + right;
+            node = node * 2 + right;
+        }
+        return way;
+    }
+};
+
+// order[way]: the 2-bit re-reference prediction value, 0 near and 3 distant. Hits
+// predict near; fills predict long (2), or for BRRIP distant (3) except 1 time in 32.
+template <bool Bimodal>
+struct Cache::RripPolicy {
+    static const uint16_t DISTANT = 3;
+
+    static void hit(Cache&, const CacheSet& set, uint32_t way) { set.order[way] = 0; }
+    static void fill(Cache& cache, const CacheSet& set, uint32_t way) {
+        set.order[way] = Bimodal && cache.generator() % 32 != 0 ? DISTANT : DISTANT - 1;
+    }
+    static uint32_t victim(Cache& cache, const CacheSet& set) {
+        // age every way until one is distant, in one step
+        uint32_t ways = cache.config.ways;
+        uint16_t oldest = 0;
+        for (uint32_t j = 0; j < ways; j++) oldest = max(oldest, set.order[j]);
+        uint16_t aging = DISTANT - oldest;
+        uint32_t way = ways;
+        for (uint32_t j = 0; j < ways; j++) {
+            if (set.order[j] == oldest && way == ways) way = j;
+            set.order[j] += aging;
+        }
+        return way;
+    }
+};
+
+// Full sets evict round robin from way 0, which is fill order since empty ways fill
+// from the front (only approximately once an inclusive level below has invalidated
+// lines). order[0] is the next victim.
+struct Cache::FifoPolicy {
+    static void hit(Cache&, const CacheSet&, uint32_t) {}
+    static void fill(Cache&, const CacheSet&, uint32_t) {}
+    static uint32_t victim(Cache& cache, const CacheSet& set) {
+        uint32_t way = set.order[0];
+        set.order[0] = (way + 1) % cache.config.ways;
+        return way;
+    }
+};
+
+struct Cache::RandomPolicy {
+    static void hit(Cache&, const CacheSet&, uint32_t) {}
+    static void fill(Cache&, const CacheSet&, uint32_t) {}
+    static uint32_t victim(Cache& cache, const CacheSet&) {
+        return cache.generator() % cache.config.ways;
+    }
+};
+
+// Constructor definition
+Cache::Cache(CacheConfig configParam, CacheDataType cacheType) : hits(0), misses(0), writebacks(0), writebackBytes(0), lastWriteBytes(0), lastEvicted(false), lastEvictedAddress(0), generator(configParam.seed), config(configParam) {
+    numSets = config.cacheSize / config.ways / config.blockSize;
+
+    offsetShift = countBitsForPowerOfTwo(config.blockSize);
     uint32_t numIndexBits = countBitsForPowerOfTwo(numSets);
-    // uint32_t numTagBits = 32 - numBlockOffsetBits - numIndexBits;
+    indexMask = (1u << numIndexBits) - 1;
+    tagShift = offsetShift + numIndexBits;
+    assert(tagShift >= 1 && "valid bit needs one bit of offset or index");
+    assert(config.ways <= 0xffff && "LRU order is kept in 16 bits");
+    assert((config.policy != REPLACE_PLRU || (config.ways & (config.ways - 1)) == 0) &&
+           "tree-PLRU needs power-of-two ways");
 
-    // uint32_t blockOffsetMask = (1 << numBlockOffsetBits) - 1;
-    uint32_t indexMask = (1 << numIndexBits) - 1;
+    // power-of-two strides up to a line pack sets without straddling, wider sets
+    // start on their own line
+    setStride = 1;
+    while (setStride < config.ways && setStride < LINE_WORDS) setStride <<= 1;
+    if (config.ways > LINE_WORDS) setStride = (config.ways + LINE_WORDS - 1) & ~(LINE_WORDS - 1);
 
-    // uint32_t blockOffset = address & blockOffsetMask;
-    uint32_t index = (address >> numBlockOffsetBits) & indexMask;
-    uint32_t tag = address >> (numBlockOffsetBits + numIndexBits);
+    tagSearch = TAG_SEARCH_SCALAR;
+#if CACHE_SIMD
+    // below 8 ways the scalar loop is as quick as setting up vectors
+    if (setStride >= 8 && config.ways < 0x8000) {
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        tagSearch = hasAvx2 ? TAG_SEARCH_AVX2 : TAG_SEARCH_SSE2;
+    }
+#endif
 
+    tags.reset(allocateLines<uint32_t>(size_t(numSets) * setStride));
+    order.reset(allocateLines<uint16_t>(size_t(numSets) * setStride));
+    dirty.reset(allocateLines<uint8_t>(size_t(numSets) * setStride));
+}
 
-    bool hit = false;
+Cache::Cache(const Cache& other)
+    : hits(other.hits), misses(other.misses), writebacks(other.writebacks),
+      writebackBytes(other.writebackBytes), lastWriteBytes(other.lastWriteBytes),
+      lastEvicted(other.lastEvicted), lastEvictedAddress(other.lastEvictedAddress),
+      numSets(other.numSets), offsetShift(other.offsetShift), indexMask(other.indexMask),
+      tagShift(other.tagShift), setStride(other.setStride), tagSearch(other.tagSearch),
+      generator(other.generator), config(other.config) {
+    size_t entries = size_t(numSets) * setStride;
+    tags.reset(copyLines(other.tags.get(), entries));
+    order.reset(copyLines(other.order.get(), entries));
+    dirty.reset(copyLines(other.dirty.get(), entries));
+}
 
-    // if hit
-    for (uint32_t i = 0; i < config.ways; i++) {
-        if (valid[index][i] && tags[index][i] == tag) {
-            hit = true;
-            // update order
-            for (uint32_t j = 0; j < config.ways; j++) {
-                if (valid[index][j] && order[index][j] < order[index][i]) {
-                    order[index][j]++;
-                }
-            }
+void Cache::save(CheckpointWriter& out) const {
+    out.put(numSets);
+    out.put(config.ways);
+    out.put(config.blockSize);
+    out.put(config.policy);
+    out.put(hits);
+    out.put(misses);
+    out.put(writebacks);
+    out.put(writebackBytes);
+    out.put(lastWriteBytes);
+    out.put(lastEvicted);
+    out.put(lastEvictedAddress);
+    size_t entries = size_t(numSets) * setStride;
+    out.write(tags.get(), entries * sizeof(uint32_t));
+    out.write(order.get(), entries * sizeof(uint16_t));
+    out.write(dirty.get(), entries * sizeof(uint8_t));
+    // the standard text form of the engine state
+    ostringstream state;
+    state << generator;
+    uint32_t length = state.str().size();
+    out.put(length);
+    out.write(state.str().data(), length);
+}
 
-            order[index][i] = 1;
-        }
+bool Cache::load(CheckpointReader& in) {
+    uint32_t sets, ways, blockSize;
+    ReplacementPolicy savedPolicy;
+    if (!in.get(sets) || !in.get(ways) || !in.get(blockSize) || !in.get(savedPolicy)) return false;
+    if (sets != numSets || ways != config.ways || blockSize != config.blockSize ||
+        savedPolicy != config.policy) {
+        return in.mismatch("checkpoint taken with another cache configuration");
     }
-    // if miss
-    if (hit == false) {
-        uint32_t numValid = 0;
-        for (uint32_t i = 0; i < config.ways; i++) {
-            if (valid[index][i]) {
-                numValid++;
-            }
-        }
 
-        // if do not need to evict
-        if (numValid < config.ways) {
-            for (uint32_t i = 0; i < config.ways; i++) {
-                if (valid[index][i]) {
-                    order[index][i]++;
-                }
-            }
-            for (uint32_t i = 0; i < config.ways; i++) {
-                if (!valid[index][i]) {
-                    tags[index][i] = tag;
-                    order[index][i] = 1;
-                    valid[index][i] = true;
-                    break;
-                }
-            }
+    size_t entries = size_t(numSets) * setStride;
+    uint32_t length = 0;
+    bool ok = in.get(hits) && in.get(misses) && in.get(writebacks) && in.get(writebackBytes) &&
+              in.get(lastWriteBytes) && in.get(lastEvicted) && in.get(lastEvictedAddress) &&
+              in.read(tags.get(), entries * sizeof(uint32_t)) &&
+              in.read(order.get(), entries * sizeof(uint16_t)) &&
+              in.read(dirty.get(), entries * sizeof(uint8_t)) && in.get(length);
+    if (!ok) return false;
+    string state(length, '\0');
+    if (!in.read(&state[0], length)) return false;
+    istringstream(state) >> generator;
+    return true;
+}
+
+// Access method definition
+bool Cache::access(uint32_t address, CacheOperation readWrite, uint32_t size) {
+    return lookup(address, readWrite, size, true);
+}
+
+bool Cache::prefetch(uint32_t address) { return !lookup(address, CACHE_READ, 0, false); }
+
+bool Cache::lookup(uint32_t address, CacheOperation readWrite, uint32_t size, bool demand) {
+    switch (config.policy) {
+        case REPLACE_PLRU:
+            return accessWith<TreePlruPolicy>(address, readWrite, size, demand);
+        case REPLACE_SRRIP:
+            return accessWith<RripPolicy<false>>(address, readWrite, size, demand);
+        case REPLACE_BRRIP:
+            return accessWith<RripPolicy<true>>(address, readWrite, size, demand);
+        case REPLACE_FIFO:
+            return accessWith<FifoPolicy>(address, readWrite, size, demand);
+        case REPLACE_RANDOM:
+            return accessWith<RandomPolicy>(address, readWrite, size, demand);
+        default:
+            return accessWith<LruPolicy>(address, readWrite, size, demand);
+    }
+}
+
+template <class Policy>
+bool Cache::accessWith(uint32_t address, CacheOperation readWrite, uint32_t size, bool demand) {
+    uint32_t index = (address >> offsetShift) & indexMask;
+    uint32_t tag = (address >> tagShift) | VALID_BIT;
+    uint32_t ways = config.ways;
+    size_t base = size_t(index) * setStride;
+    CacheSet set = {&tags[base], &order[base], &dirty[base]};
+    bool writeThrough = readWrite == CACHE_WRITE && config.writePolicy == WRITE_THROUGH;
+    lastWriteBytes = 0;
+    lastEvicted = false;
+
+    int way = findWay(set.tags, tag);
+    if (way >= 0 && !demand) return true;  // a prefetch leaves cached lines alone
+    if (way >= 0) {
+        Policy::hit(*this, set, way);
+        if (writeThrough) {
+            writeNextLevel(size);
+        } else if (readWrite == CACHE_WRITE) {
+            set.dirty[way] = 1;
         }
-        else
-        {
-            for (uint32_t i = 0; i < config.ways; i++) {
-                if (order[index][i] == config.ways) {
-                    tags[index][i] = tag;
-                }
-            }
-            // reorder
-            for (uint32_t j = 0; j < config.ways; j++) {
-                order[index][j] = order[index][j] % config.ways + 1;
-            }
+        hits++;
+        return true;
+    }
+
+    misses += demand;
+    if (writeThrough) {
+        // no-write-allocate: the store goes around the cache
+        writeNextLevel(size);
+        return false;
+    }
+
+    // fill the first empty way, if any
+    uint32_t fillWay = 0;
+    while (fillWay < ways && set.tags[fillWay]) fillWay++;
+    if (fillWay == ways) {
+        fillWay = Policy::victim(*this, set);
+        lastEvicted = true;
+        lastEvictedAddress = ((set.tags[fillWay] & ~VALID_BIT) << tagShift) | (index << offsetShift);
+        if (set.dirty[fillWay]) writeNextLevel(config.blockSize);
+    }
+
+    set.tags[fillWay] = tag;
+    set.dirty[fillWay] = readWrite == CACHE_WRITE;
+    Policy::fill(*this, set, fillWay);
+    return false;
+}
+
+uint32_t Cache::invalidate(uint32_t address) {
+    uint32_t index = (address >> offsetShift) & indexMask;
+    size_t base = size_t(index) * setStride;
+    int way = findWay(&tags[base], (address >> tagShift) | VALID_BIT);
+    if (way < 0) return 0;
+
+    uint32_t written = dirty[base + way] ? config.blockSize : 0;
+    if (written) writeNextLevel(written);
+    tags[base + way] = 0;
+    dirty[base + way] = 0;
+    if (config.policy == REPLACE_LRU) {
+        // keep the valid ways numbered 1..n, and mark this one empty
+        uint16_t* setOrder = &order[base];
+        for (uint32_t j = 0; j < config.ways; j++) {
+            if (setOrder[j] > setOrder[way]) setOrder[j]--;
         }
+        setOrder[way] = 0;
     }
-    hits += hit;
-    misses += !hit;
-    return hit;
+    return written;
+}
+
+void Cache::writeNextLevel(uint32_t bytes) {
+    writebacks++;
+    writebackBytes += bytes;
+    lastWriteBytes += bytes;
 }
 
 // Dump method definition, you can write your own dump info
@@ -145,9 +458,9 @@ Status Cache::dump(const std::string& base_output_name) {
         cache_out << "Ways: " << (config.ways == 1) << std::endl;
         cache_out << "Miss Latency: " << config.missLatency << " cycles" << std::endl;
         cache_out << endl;
-        for (auto v : valid) {
-            for (auto c : v) {
-                cache_out << c << " ";
+        for (uint32_t set = 0; set < numSets; set++) {
+            for (uint32_t i = 0; i < config.ways; i++) {
+                cache_out << (tags[size_t(set) * setStride + i] != 0) << " ";
             }
             cache_out << endl;
         }
@@ -157,9 +470,219 @@ Status Cache::dump(const std::string& base_output_name) {
         cache_out << "---------------------" << endl;
         return SUCCESS;
     } else {
-        cerr << LOG_ERROR << "Could not create cache state dump file" << endl;
+        TRACE_ERROR(TRACE_CACHE, "Could not create cache state dump file");
         return ERROR;
     }
 
     // Here you can also dump the state of the cache, its stats, or any other relevant information
 }
+
+static const char* const POLICY_NAMES[] = {"lru", "plru", "srrip", "brrip", "fifo", "random"};
+
+const char* replacementPolicyName(ReplacementPolicy policy) { return POLICY_NAMES[policy]; }
+
+Status parseReplacementPolicy(const string& name, ReplacementPolicy& policy) {
+    for (int i = REPLACE_LRU; i <= REPLACE_RANDOM; i++) {
+        if (name == POLICY_NAMES[i]) {
+            policy = ReplacementPolicy(i);
+            return SUCCESS;
+        }
+    }
+    return ERROR;
+}
+
+static const char* const WRITE_POLICY_NAMES[] = {"writeback", "writethrough"};
+
+const char* writePolicyName(WritePolicy policy) { return WRITE_POLICY_NAMES[policy]; }
+
+Status parseWritePolicy(const string& name, WritePolicy& policy) {
+    for (int i = WRITE_BACK; i <= WRITE_THROUGH; i++) {
+        if (name == WRITE_POLICY_NAMES[i]) {
+            policy = WritePolicy(i);
+            return SUCCESS;
+        }
+    }
+    return ERROR;
+}
+
+static const char* const PREFETCHER_NAMES[] = {"none", "nextline", "stride", "stream"};
+
+const char* prefetcherName(PrefetcherKind kind) { return PREFETCHER_NAMES[kind]; }
+
+Status parsePrefetcher(const string& name, PrefetcherKind& kind) {
+    for (int i = PREFETCH_NONE; i <= PREFETCH_STREAM; i++) {
+        if (name == PREFETCHER_NAMES[i]) {
+            kind = PrefetcherKind(i);
+            return SUCCESS;
+        }
+    }
+    return ERROR;
+}
+
+// One "key value" line of a config, key without its ic./dc. prefix.
+static Status setCacheOption(CacheConfig& config, const string& key, const string& value) {
+    if (key == "policy") return parseReplacementPolicy(value, config.policy);
+    if (key == "write_policy") return parseWritePolicy(value, config.writePolicy);
+    if (key == "prefetcher") return parsePrefetcher(value, config.prefetcher);
+    if (key == "inclusion") {
+        config.inclusive = value == "inclusive";
+        return config.inclusive || value == "noninclusive" ? SUCCESS : ERROR;
+    }
+
+    uint32_t* number = key == "size"                ? &config.cacheSize
+                       : key == "block_size"        ? &config.blockSize
+                       : key == "ways"              ? &config.ways
+                       : key == "latency"           ? &config.missLatency
+                       : key == "seed"              ? &config.seed
+                       : key == "writeback_latency" ? &config.writebackLatency
+                       : key == "prefetch_degree"   ? &config.prefetchDegree
+                       : key == "prefetch_distance" ? &config.prefetchDistance
+                                                    : nullptr;
+    if (!number) return ERROR;
+    char* end;
+    *number = strtoul(value.c_str(), &end, 0);
+    return *end == '\0' ? SUCCESS : ERROR;
+}
+
+static Status checkCacheOptions(const CacheConfig& config, const char* name) {
+    if (config.policy == REPLACE_PLRU && (config.ways & (config.ways - 1)) != 0) {
+        TRACE_ERROR(TRACE_SIM, name << " uses plru with " << config.ways
+                                    << " ways, tree-PLRU needs a power of two");
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+// L2 and L3 only exist through options, so their geometry is checked as well
+static Status checkLevelConfig(const CacheConfig& config, const char* name) {
+    if (config.blockSize == 0 || (config.blockSize & (config.blockSize - 1)) != 0 ||
+        config.ways == 0 || config.cacheSize % (config.blockSize * config.ways) != 0) {
+        TRACE_ERROR(TRACE_SIM, name << " needs a power-of-two block_size, ways, and a size that"
+                                       " is a multiple of block_size times ways");
+        return ERROR;
+    }
+    if (config.prefetcher != PREFETCH_NONE) {
+        TRACE_ERROR(TRACE_SIM, name << " cannot prefetch, only the L1s have prefetchers");
+        return ERROR;
+    }
+    return checkCacheOptions(config, name);
+}
+
+Status parseCacheConfig(istream& in, CacheConfigSet& configs) {
+    int line = 0;
+    bool ok = true;
+    auto parseNextLine = [&](const char* name) -> uint32_t {
+        line++;
+        uint32_t value = 0;
+        if (ok && !(in >> value)) {
+            TRACE_ERROR(TRACE_SIM, "Failed to parse property at line " << line
+                                                                       << " for property " << name);
+            ok = false;
+        }
+        string discard;
+        getline(in, discard);  // discard rest of the line
+        return value;
+    };
+
+    configs.icConfig = CacheConfig{parseNextLine("ICache cache size"),
+                                   parseNextLine("ICache block size"),
+                                   parseNextLine("ICache ways"),
+                                   parseNextLine("ICache miss latency")};
+    configs.dcConfig = CacheConfig{parseNextLine("DCache cache size"),
+                                   parseNextLine("DCache block size"),
+                                   parseNextLine("DCache ways"),
+                                   parseNextLine("DCache miss latency")};
+    configs.l2Config = configs.l3Config = CacheConfig{0, 0, 0, 0};
+
+    string text;
+    while (ok && getline(in, text)) {
+        line++;
+        istringstream fields(text.substr(0, text.find('#')));
+        string key, value, extra;
+        if (!(fields >> key)) continue;  // blank or comment
+        if (!(fields >> value) || fields >> extra) {
+            TRACE_ERROR(TRACE_SIM, "Expected \"key value\" at line " << line);
+            ok = false;
+            break;
+        }
+
+        CacheConfig* targets[2] = {&configs.icConfig, &configs.dcConfig};
+        string name = key;
+        if (key.size() > 3 && key[2] == '.') {
+            string level = key.substr(0, 2);
+            targets[0] = level == "ic"   ? &configs.icConfig
+                         : level == "dc" ? &configs.dcConfig
+                         : level == "l2" ? &configs.l2Config
+                         : level == "l3" ? &configs.l3Config
+                                         : nullptr;
+            targets[1] = nullptr;
+            name = key.substr(3);
+        }
+        Status status = targets[0] ? SUCCESS : ERROR;
+        for (CacheConfig* target : targets) {
+            if (status == SUCCESS && target) status = setCacheOption(*target, name, value);
+        }
+        if (status != SUCCESS) {
+            TRACE_ERROR(TRACE_SIM, "Bad cache option " << key << " " << value << " at line "
+                                                       << line);
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        ok = checkCacheOptions(configs.icConfig, "ICache") == SUCCESS &&
+             checkCacheOptions(configs.dcConfig, "DCache") == SUCCESS;
+    }
+    if (ok && configs.l2Config.cacheSize > 0) {
+        ok = checkLevelConfig(configs.l2Config, "L2") == SUCCESS;
+    }
+    if (ok && configs.l3Config.cacheSize > 0) {
+        ok = checkLevelConfig(configs.l3Config, "L3") == SUCCESS;
+        if (ok && configs.l2Config.cacheSize == 0) {
+            TRACE_ERROR(TRACE_SIM, "An L3 needs an L2");
+            ok = false;
+        }
+    }
+    return ok ? SUCCESS : ERROR;
+}
+
+Status parseCacheConfigFile(const string& fileName, vector<CacheConfigSet>& configs) {
+    ifstream file(fileName);
+    if (!file.is_open()) {
+        TRACE_ERROR(TRACE_SIM, "Failed to open cache config file: " << fileName);
+        return ERROR;
+    }
+
+    configs.clear();
+    string block, text;
+    auto endBlock = [&]() -> Status {
+        bool empty = block.find_first_not_of(" \t\r\n") == string::npos;
+        istringstream in(block);
+        block.clear();
+        if (empty) return SUCCESS;
+
+        CacheConfigSet config;
+        if (parseCacheConfig(in, config) != SUCCESS) {
+            TRACE_ERROR(TRACE_SIM, "in config " << configs.size() + 1 << " of " << fileName);
+            return ERROR;
+        }
+        configs.push_back(config);
+        return SUCCESS;
+    };
+
+    while (getline(file, text)) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first != string::npos && text.compare(first, 3, "---") == 0) {
+            if (endBlock() != SUCCESS) return ERROR;
+        } else {
+            block += text + "\n";
+        }
+    }
+    if (endBlock() != SUCCESS) return ERROR;
+
+    if (configs.empty()) {
+        TRACE_ERROR(TRACE_SIM, "No cache config found in " << fileName);
+        return ERROR;
+    }
+    return SUCCESS;
+}
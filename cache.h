@@ -8,14 +8,55 @@
 #pragma once
 #include <inttypes.h>
 
+#include <cstdlib>
 #include <iostream>
-
+#include <memory>
+#include <random>
 #include <vector>
 
 #include "Utilities.h"
 
 using namespace std;
 
+class CheckpointReader;
+class CheckpointWriter;
+
+// Which block a full set gives up on a miss.
+enum ReplacementPolicy {
+    REPLACE_LRU,     // true LRU
+    REPLACE_PLRU,    // tree pseudo-LRU, power-of-two ways only
+    REPLACE_SRRIP,   // static re-reference interval prediction, 2-bit
+    REPLACE_BRRIP,   // bimodal RRIP, inserts distant except 1 time in 32
+    REPLACE_FIFO,    // oldest fill
+    REPLACE_RANDOM   // uniform, from a seeded generator
+};
+
+const char* replacementPolicyName(ReplacementPolicy policy);
+// Accepts the names above in lower case ("lru", "plru", ...).
+Status parseReplacementPolicy(const std::string& name, ReplacementPolicy& policy);
+
+// What a store does to the cache and to the next level.
+enum WritePolicy {
+    WRITE_BACK,    // write-allocate, dirty lines go to the next level when evicted
+    WRITE_THROUGH  // no-write-allocate, every store goes to the next level
+};
+
+const char* writePolicyName(WritePolicy policy);
+// Accepts "writeback" and "writethrough".
+Status parseWritePolicy(const std::string& name, WritePolicy& policy);
+
+// What an L1 brings in ahead of demand, see Prefetcher.h.
+enum PrefetcherKind {
+    PREFETCH_NONE,
+    PREFETCH_NEXT_LINE,  // the blocks after a miss
+    PREFETCH_STRIDE,     // per load/store PC strides, from a reference prediction table
+    PREFETCH_STREAM      // ascending or descending runs of missed blocks
+};
+
+const char* prefetcherName(PrefetcherKind kind);
+// Accepts "none", "nextline", "stride" and "stream".
+Status parsePrefetcher(const std::string& name, PrefetcherKind& kind);
+
 struct CacheConfig {
     // Cache size in bytes.
     uint32_t cacheSize;
@@ -25,43 +66,174 @@ struct CacheConfig {
     uint32_t ways;
     // Additional miss latency in cycles.
     uint32_t missLatency;
+    // Replacement policy and the seed for the policies that draw random numbers.
+    ReplacementPolicy policy = REPLACE_LRU;
+    uint32_t seed = 42;
+    // Write policy, and the cycles a store to the next level stalls for (a dirty
+    // eviction, or a written-through store).
+    WritePolicy writePolicy = WRITE_BACK;
+    uint32_t writebackLatency = 0;
+    // For L2 and L3: whether this level keeps a copy of every line cached above it,
+    // dropping those lines when it evicts its own.
+    bool inclusive = false;
+    // L1 only: the prefetcher, how many blocks it brings in per trigger (degree), and
+    // how many blocks ahead of the triggering access the first of them is (distance).
+    PrefetcherKind prefetcher = PREFETCH_NONE;
+    uint32_t prefetchDegree = 1;
+    uint32_t prefetchDistance = 1;
     // debug: Overload << operator to allow easy printing of CacheConfig
     friend std::ostream& operator<<(std::ostream& os, const CacheConfig& config) {
         os << "CacheConfig { " << config.cacheSize << ", " << config.blockSize << ", "
-           << config.ways << ", " << config.missLatency << " }";
+           << config.ways << ", " << config.missLatency << ", "
+           << replacementPolicyName(config.policy) << ", " << writePolicyName(config.writePolicy)
+           << ", " << config.writebackLatency << " }";
         return os;
     }
 };
 
+// Everything one cache config file describes. L2 and L3 are unified levels below the
+// L1s, each present when its size is not 0 (an L3 needs an L2).
+struct CacheConfigSet {
+    CacheConfig icConfig;
+    CacheConfig dcConfig;
+    CacheConfig l2Config = CacheConfig{0, 0, 0, 0};
+    CacheConfig l3Config = CacheConfig{0, 0, 0, 0};
+};
+
+// Reads one config: 8 numeric lines, I-cache size, block size, ways and miss latency,
+// then the same for the D-cache. Anything after the number on a line is ignored.
+// Optional "key value" lines may follow, "#" starts a comment. A key applies to both
+// L1s, or to one cache with an "ic.", "dc.", "l2." or "l3." prefix:
+//   size N, block_size N, ways N, latency N (the miss latency)
+//   policy lru|plru|srrip|brrip|fifo|random
+//   seed N
+//   write_policy writeback|writethrough
+//   writeback_latency N
+//   inclusion inclusive|noninclusive
+//   prefetcher none|nextline|stride|stream, prefetch_degree N, prefetch_distance N
+Status parseCacheConfig(std::istream& in, CacheConfigSet& configs);
+
+// Reads a file holding one or more configs, separated by lines of "---".
+Status parseCacheConfigFile(const std::string& fileName, std::vector<CacheConfigSet>& configs);
+
 enum CacheDataType { I_CACHE = false, D_CACHE = true };
 enum CacheOperation { CACHE_READ = false, CACHE_WRITE = true };
 
 class Cache {
    private:
-    /**TODO[students] include other states, e.g. associativity, cache tables */
+    // Tag words carry the valid bit in bit 31; an offset plus index of at least one bit
+    // keeps it clear of every real tag, and an all-zero word is an empty way.
+    static const uint32_t VALID_BIT = 0x80000000u;
+    static const uint32_t LINE_WORDS = 64 / sizeof(uint32_t);
+
+    struct AlignedFree {
+        void operator()(void* p) const { free(p); }
+    };
+    template <typename T>
+    using AlignedArray = std::unique_ptr<T[], AlignedFree>;
+
+    // how access() looks up a set, picked once per cache from the geometry and the CPU
+    enum TagSearch { TAG_SEARCH_SCALAR, TAG_SEARCH_SSE2, TAG_SEARCH_AVX2 };
+
+    // Replacement policies, one per ReplacementPolicy. Each is a set of static hooks
+    // access() is instantiated with; they share the per-set order[] slots:
+    //   void hit(Cache&, const CacheSet&, uint32_t way)
+    //   void fill(Cache&, const CacheSet&, uint32_t way)   // way was empty or the victim
+    //   uint32_t victim(Cache&, const CacheSet&)           // only asked of full sets
+    struct CacheSet {
+        uint32_t* tags;
+        uint16_t* order;
+        uint8_t* dirty;
+    };
+    struct LruPolicy;
+    struct TreePlruPolicy;
+    template <bool Bimodal>
+    struct RripPolicy;
+    struct FifoPolicy;
+    struct RandomPolicy;
+
+    template <class Policy>
+    bool accessWith(uint32_t address, CacheOperation readWrite, uint32_t size, bool demand);
+    // access() and prefetch(), which fills like a read miss without counting anything
+    bool lookup(uint32_t address, CacheOperation readWrite, uint32_t size, bool demand);
+    void writeNextLevel(uint32_t bytes);
+    int findWay(const uint32_t* setTags, uint32_t tag) const;
+
     uint32_t hits, misses;
+    // stores sent to the next level: dirty lines evicted, or stores written through
+    uint32_t writebacks;
+    uint64_t writebackBytes;
+    uint32_t lastWriteBytes;
+    // the valid line the last access replaced, if any
+    bool lastEvicted;
+    uint32_t lastEvictedAddress;
 
     uint32_t numSets; // number of rows in cache (numSets = cacheSize/ways/blockSize)
-    vector<vector<uint32_t>> tags; // the tags in the cache currently
-    vector<vector<uint32_t>> order; // for each row, stores 1, 2, 3 ... n (the order of most recent to least recent)
-    vector<vector<bool>> valid; // whether each cell is valid
+    // geometry, fixed at construction
+    uint32_t offsetShift;
+    uint32_t indexMask;
+    uint32_t tagShift;
+    // ways between the start of consecutive sets; sets never straddle a cache line, and
+    // strides of 8 or more are whole vectors (the padding ways stay empty)
+    uint32_t setStride;
+    TagSearch tagSearch;
+
+    // numSets * setStride entries each, 64-byte aligned
+    AlignedArray<uint32_t> tags; // tag | VALID_BIT, or 0 when the way is empty
+    AlignedArray<uint16_t> order; // replacement state, 0 for empty ways under LRU
+    AlignedArray<uint8_t> dirty; // 1 when a write-back line differs from memory
+
+    std::mt19937 generator;  // random and BRRIP only, seeded from config.seed
 
    public:
     CacheConfig config;
     // Constructor to initialize the cache parameters
     Cache(CacheConfig configParam, CacheDataType cacheType);
+    // the same lines, replacement state, counters and generator state
+    Cache(const Cache& other);
+    Cache& operator=(const Cache&) = delete;
 
     /** Access methods for reading/writing
      * @return true for hit and false for miss
      * @param
      *      address: memory address
      *      readWrite: true for read operation and false for write operation
+     *      size: bytes written, for write-through traffic
+     */
+    bool access(uint32_t address, CacheOperation readWrite, uint32_t size = 4);
+
+    /** Brings the block holding address in ahead of demand without counting a hit or
+     * miss. A block already cached keeps its replacement state; a fill picks its victim
+     * and updates the replacement state (ages the other ways, draws from the generator
+     * under random and BRRIP) exactly as a read-miss fill does
+     * @return true if the block was not cached and has been filled
      */
-    bool access(uint32_t address, CacheOperation readWrite);
+    bool prefetch(uint32_t address);
 
     // dump information as you needed, write your own dump function
     Status dump(const std::string& base_output_name);
 
-    uint32_t getHits() { return hits; }
-    uint32_t getMisses() { return misses; }
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint32_t getWritebacks() const { return writebacks; }
+    uint64_t getWritebackBytes() const { return writebackBytes; }
+    // zeroes hits, misses and writebacks, leaving the lines alone
+    void resetStats() { hits = misses = writebacks = 0, writebackBytes = 0; }
+    // bytes the last access sent to the next level, 0 if none
+    uint32_t getLastWriteBytes() const { return lastWriteBytes; }
+    // whether the last access replaced a valid line, and that line's block address
+    bool getLastEviction(uint32_t& blockAddress) const {
+        blockAddress = lastEvictedAddress;
+        return lastEvicted;
+    }
+
+    // every line, the replacement state, counters and generator state (see
+    // Checkpoint.h); load() fails unless the geometry and policy are the same
+    void save(CheckpointWriter& out) const;
+    bool load(CheckpointReader& in);
+
+    /** Drops the line holding address, for inclusive levels below this one
+     * @return the bytes written back: a block if the line was dirty, else 0
+     */
+    uint32_t invalidate(uint32_t address);
 };
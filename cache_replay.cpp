@@ -0,0 +1,166 @@
+/**
+ * cache_replay
+ * Feeds an access trace recorded by sim_funct --access-trace through the caches of every
+ * config in a config file, one config per thread, without re-executing the program.
+ *
+ *   cache_replay [--jobs=N] [--out=FILE] <configs.txt> <trace.bin>
+ *
+ * configs.txt is a sim_cycle cache config, or several separated by "---" lines. Fetches
+ * go to the I-cache and loads and stores to the D-cache, in trace order, through the
+ * L2 and L3 when configured. Prefetch timing counts one cycle per fetch, as if nothing
+ * ever stalled. Prints CSV, one row per config, to stdout unless --out is given, with
+ * the status and statistics columns of sim_batch in the same order; dynamicInstructions
+ * is the number of fetches, and totalCycles and loadUseStalls, which need the pipeline,
+ * are left empty.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AccessTrace.h"
+#include "CacheHierarchy.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include "cache.h"
+
+using namespace std;
+
+struct ReplayJob {
+    Status status;
+    uint64_t accesses;
+    SimulationStats stats;
+};
+
+static void runJob(ReplayJob& job, const string& traceFile, const CacheConfigSet& configs) {
+    AccessTraceReader trace;
+    if (trace.open(traceFile) != SUCCESS) {
+        job.status = ERROR;
+        return;
+    }
+
+    CacheHierarchy caches(configs);
+    AccessRecord record;
+    uint64_t now = 0;
+    while (trace.next(record)) {
+        job.accesses++;
+        switch (record.kind) {
+            case ACCESS_FETCH:
+                caches.fetch(record.pc, now++);
+                job.stats.dynamicInstructions++;
+                break;
+            case ACCESS_LOAD:
+                // sim_cycle reads the whole word whatever the load size
+                caches.data(record.pc, record.address, CACHE_READ, 4, now);
+                break;
+            case ACCESS_STORE:
+                caches.data(record.pc, record.address, CACHE_WRITE, record.size, now);
+                break;
+        }
+    }
+    if (trace.failed()) {
+        job.status = ERROR;
+        return;
+    }
+
+    SimulationStats& s = job.stats;
+    s.icHits = caches.getICache().getHits();
+    s.icMisses = caches.getICache().getMisses();
+    s.dcHits = caches.getDCache().getHits();
+    s.dcMisses = caches.getDCache().getMisses();
+    if (const Cache* l2 = caches.getL2()) {
+        s.l2Hits = l2->getHits();
+        s.l2Misses = l2->getMisses();
+    }
+    if (const Cache* l3 = caches.getL3()) {
+        s.l3Hits = l3->getHits();
+        s.l3Misses = l3->getMisses();
+    }
+    s.writebacks = caches.getDCache().getWritebacks();
+    s.writebackBytes = caches.getDCache().getWritebackBytes();
+    s.icPrefetches = caches.getIPrefetchStats().issued;
+    s.icPrefetchesUseful = caches.getIPrefetchStats().useful;
+    s.icPrefetchesLate = caches.getIPrefetchStats().late;
+    s.dcPrefetches = caches.getDPrefetchStats().issued;
+    s.dcPrefetchesUseful = caches.getDPrefetchStats().useful;
+    s.dcPrefetchesLate = caches.getDPrefetchStats().late;
+    job.status = SUCCESS;
+}
+
+static void writeCsv(ostream& out, const vector<ReplayJob>& jobs) {
+    out << "config,accesses,status,dynamicInstructions,totalCycles,icHits,icMisses,dcHits,"
+           "dcMisses,l2Hits,l2Misses,l3Hits,l3Misses,loadUseStalls,writebacks,writebackBytes,"
+           "icPrefetches,icPrefetchesUseful,icPrefetchesLate,dcPrefetches,dcPrefetchesUseful,"
+           "dcPrefetchesLate\n";
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const SimulationStats& s = jobs[i].stats;
+        // totalCycles and loadUseStalls are empty
+        out << i << "," << jobs[i].accesses << "," << statusName(jobs[i].status) << ","
+            << s.dynamicInstructions << ",," << s.icHits << "," << s.icMisses << ","
+            << s.dcHits << "," << s.dcMisses << "," << s.l2Hits << "," << s.l2Misses << ","
+            << s.l3Hits << "," << s.l3Misses << ",," << s.writebacks << ","
+            << s.writebackBytes << "," << s.icPrefetches << "," << s.icPrefetchesUseful << ","
+            << s.icPrefetchesLate << "," << s.dcPrefetches << "," << s.dcPrefetchesUseful
+            << "," << s.dcPrefetchesLate << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned workers = 0;
+    string outFile;
+    vector<string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            workers = strtoul(argv[i] + 7, nullptr, 0);
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            outFile = argv[i] + 6;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
+            return ERROR;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 2) {
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0]
+                                         << " [--jobs=N] [--out=FILE] <configs.txt> <trace.bin>");
+        return ERROR;
+    }
+
+    vector<CacheConfigSet> configs;
+    if (parseCacheConfigFile(positional[0], configs) != SUCCESS) return ERROR;
+
+    vector<ReplayJob> jobs(configs.size(), ReplayJob{ERROR, 0, {}});
+    {
+        ThreadPool pool(workers);
+        TRACE_INFO(TRACE_SIM, "Replaying " << positional[1] << " through " << configs.size()
+                                           << " configs on " << pool.size() << " threads");
+        for (size_t c = 0; c < configs.size(); c++) {
+            ReplayJob* job = &jobs[c];
+            const CacheConfigSet* config = &configs[c];
+            const string* traceFile = &positional[1];
+            pool.submit([job, config, traceFile] { runJob(*job, *traceFile, *config); });
+        }
+        pool.wait();
+    }
+
+    ofstream file;
+    if (!outFile.empty()) {
+        file.open(outFile);
+        if (!file) {
+            TRACE_ERROR(TRACE_SIM, "Could not create replay results file " << outFile);
+            return ERROR;
+        }
+    }
+    writeCsv(outFile.empty() ? cout : file, jobs);
+
+    for (const ReplayJob& job : jobs) {
+        if (job.status != SUCCESS) return ERROR;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,152 @@
+/**
+ * cache_sweep
+ * Runs a program once on the functional emulator, records its I-cache and D-cache
+ * access streams, and reports LRU hits and misses for every power-of-two set count and
+ * every way count at one block size (see StackDistance.h).
+ *
+ * The I-stream is the fetches sim_cycle makes. The D-stream is the architectural order
+ * of loads and stores, one access each. sim_cycle also repeats a memory access while
+ * the pipeline stalls and flushes the pipeline at the halt, and both depend on the
+ * cache latencies, so its D-cache counts differ from the sweep's.
+ *
+ *   cache_sweep <file.bin> [--block=N] [--max-size=N] [--max-ways=N]
+ *               [--max-instructions=N] [--verify] [--threads=N]
+ *
+ * Prints CSV: cache,size,sets,ways,hits,misses. --verify also replays the streams
+ * through a Cache of every reported geometry, sharded over --threads workers (default:
+ * one per hardware thread, see ShardedReplay.h), and fails if any count differs.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "ElfLoader.h"
+#include "MemoryStore.h"
+#include "ShardedReplay.h"
+#include "StackDistance.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include "cache.h"
+#include "emulator.h"
+
+using namespace std;
+
+static bool isPowerOfTwo(uint32_t n) { return n && (n & (n - 1)) == 0; }
+
+// every executed instruction is fetched, as in sim_cycle; loads and stores then access
+// the D-cache once each, in program order
+static void recordStreams(Emulator& emulator, uint32_t maxInstructions,
+                          vector<uint32_t>& iStream, vector<uint32_t>& dStream) {
+    for (uint32_t n = 0; maxInstructions == 0 || n < maxInstructions; n++) {
+        Emulator::InstructionInfo info = emulator.executeInstruction();
+        if (!info.isValid || info.isOverflow) continue;
+
+        iStream.push_back(info.pc);
+        switch (info.opcode) {
+            case OP_LBU:
+            case OP_LHU:
+            case OP_LW:
+                dStream.push_back(info.loadAddress);
+                break;
+            case OP_SB:
+            case OP_SH:
+            case OP_SW:
+                dStream.push_back(info.storeAddress);
+                break;
+        }
+        if (info.isHalt) break;
+    }
+}
+
+static bool report(const char* name, const vector<uint32_t>& stream, uint32_t blockSize,
+                   uint32_t maxSize, uint32_t maxWays, ThreadPool* verifyPool) {
+    uint32_t maxSets = maxSize / blockSize;
+    StackDistanceSweep sweep(blockSize, maxSets, maxWays);
+    sweep.run(stream);
+
+    bool ok = true;
+    for (uint32_t sets = 1; sets <= maxSets; sets <<= 1) {
+        for (uint32_t ways = 1; ways <= maxWays && sets * ways * blockSize <= maxSize; ways++) {
+            uint32_t size = sets * ways * blockSize;
+            uint64_t hits = sweep.getHits(sets, ways);
+            uint64_t misses = sweep.getMisses(sets, ways);
+            cout << name << "," << size << "," << sets << "," << ways << "," << hits << ","
+                 << misses << "\n";
+
+            if (verifyPool) {
+                ShardedReplay replay(CacheConfig{size, blockSize, ways, 0}, *verifyPool);
+                ReplayStats stats = replay.run(stream);
+                if (stats.hits != hits || stats.misses != misses) {
+                    TRACE_ERROR(TRACE_CACHE, name << " " << size << "B " << ways
+                                                  << "-way: Cache gives " << stats.hits
+                                                  << "/" << stats.misses);
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t blockSize = 16;
+    uint32_t maxSize = 64 * 1024;
+    uint32_t maxWays = 16;
+    uint32_t maxInstructions = 0;
+    bool verify = false;
+    unsigned threads = 0;
+    const char* inputFile = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--block=", 8) == 0) {
+            blockSize = strtoul(argv[i] + 8, nullptr, 0);
+        } else if (strncmp(argv[i], "--max-size=", 11) == 0) {
+            maxSize = strtoul(argv[i] + 11, nullptr, 0);
+        } else if (strncmp(argv[i], "--max-ways=", 11) == 0) {
+            maxWays = strtoul(argv[i] + 11, nullptr, 0);
+        } else if (strncmp(argv[i], "--max-instructions=", 19) == 0) {
+            maxInstructions = strtoul(argv[i] + 19, nullptr, 0);
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = strtoul(argv[i] + 10, nullptr, 0);
+        } else if (strncmp(argv[i], "--", 2) == 0 || inputFile) {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
+            return ERROR;
+        } else {
+            inputFile = argv[i];
+        }
+    }
+
+    if (!inputFile) {
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0]
+                                         << " <file.bin|file.elf> [--block=N] [--max-size=N] [--max-ways=N]"
+                                            " [--max-instructions=N] [--verify] [--threads=N]");
+        return ERROR;
+    }
+    if (!isPowerOfTwo(blockSize) || !isPowerOfTwo(maxSize) || maxSize < blockSize ||
+        maxWays == 0) {
+        TRACE_ERROR(TRACE_SIM, "Block and maximum size must be powers of two, block <= size, "
+                               "and at least one way");
+        return ERROR;
+    }
+
+    MemoryStore* memory = new MemoryStore(0, MEMORY_SIZE);
+    uint32_t entry;
+    if (loadProgram(memory, inputFile, entry) != SUCCESS) return ERROR;
+    Emulator emulator;
+    emulator.setMemory(memory);
+    emulator.setPC(entry);
+
+    vector<uint32_t> iStream, dStream;
+    recordStreams(emulator, maxInstructions, iStream, dStream);
+
+    unique_ptr<ThreadPool> pool(verify ? new ThreadPool(threads) : nullptr);
+    cout << "cache,size,sets,ways,hits,misses\n";
+    bool ok = report("I", iStream, blockSize, maxSize, maxWays, pool.get());
+    ok = report("D", dStream, blockSize, maxSize, maxWays, pool.get()) && ok;
+    return ok ? SUCCESS : ERROR;
+}
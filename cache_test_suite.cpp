@@ -1,12 +1,16 @@
 #include <iostream>
+#include <random>
 #include <vector>
 
+#include "CacheHierarchy.h"
+#include "ShardedReplay.h"
 #include "cache.h"
 
 using namespace std;
 
-void test_cache(int test_num, uint32_t cacheSize, uint32_t blockSize, uint32_t ways, int hits, int misses, std::vector<uint32_t> test_addresses) {
+void test_cache(int test_num, uint32_t cacheSize, uint32_t blockSize, uint32_t ways, int hits, int misses, std::vector<uint32_t> test_addresses, ReplacementPolicy policy = REPLACE_LRU) {
     CacheConfig cc = {cacheSize, blockSize, ways, 5};
+    cc.policy = policy;
     CacheDataType ctype = {I_CACHE};
     CacheOperation cor = {CACHE_READ};
     CacheOperation cow = {CACHE_WRITE};
@@ -40,6 +44,106 @@ void test_cache(int test_num, uint32_t cacheSize, uint32_t blockSize, uint32_t w
     }
 }
 
+void test_writebacks(int test_num, WritePolicy policy, uint32_t writebacks, uint64_t bytes, std::vector<std::pair<uint32_t, CacheOperation>> test_accesses) {
+    CacheConfig cc = {8, 4, 1, 5};
+    cc.writePolicy = policy;
+    Cache cache = Cache(cc, D_CACHE);
+
+    for (auto access : test_accesses) {
+        cache.access(access.first, access.second, 2);
+    }
+    bool test = cache.getWritebacks() == writebacks && cache.getWritebackBytes() == bytes;
+    cout << "Test " << test_num << " Writebacks: " << (test ? "Passed" : "Failed") << endl;
+}
+
+void test_inclusion(int test_num, bool inclusive, uint32_t l1Hits, std::vector<uint32_t> test_addresses) {
+    CacheConfigSet configs;
+    configs.icConfig = {8, 4, 2, 5};
+    configs.dcConfig = {8, 4, 2, 5};
+    configs.l2Config = {4, 4, 1, 20};
+    configs.l2Config.inclusive = inclusive;
+    CacheHierarchy caches(configs);
+
+    for (uint32_t address : test_addresses) {
+        caches.data(0, address, CACHE_READ, 4, 0);
+    }
+    bool test = caches.getDCache().getHits() == l1Hits;
+    cout << "Test " << test_num << " Inclusion: " << (test ? "Passed" : "Failed") << endl;
+}
+
+void test_inclusive_writeback(int test_num, bool inclusive, uint32_t l3Hits) {
+    CacheConfigSet configs;
+    configs.icConfig = {8, 4, 2, 5};
+    configs.dcConfig = {8, 4, 2, 5};
+    configs.l2Config = {4, 4, 1, 20};
+    configs.l2Config.inclusive = inclusive;
+    configs.l3Config = {64, 4, 4, 50};
+    CacheHierarchy caches(configs);
+
+    caches.data(0, 0b000, CACHE_WRITE, 4, 0);
+    caches.data(0, 0b100, CACHE_READ, 4, 0);
+    bool test = caches.getDCache().getWritebacks() == (inclusive ? 1u : 0u) && caches.getL3()->getHits() == l3Hits;
+    cout << "Test " << test_num << " Inclusive writeback: " << (test ? "Passed" : "Failed") << endl;
+}
+
+void test_prefetch(int test_num, PrefetcherKind prefetcher, uint32_t misses, uint32_t useful, std::vector<uint32_t> test_addresses) {
+    CacheConfigSet configs;
+    configs.icConfig = {64, 4, 16, 5};
+    configs.dcConfig = {64, 4, 16, 5};
+    configs.dcConfig.prefetcher = prefetcher;
+    CacheHierarchy caches(configs);
+
+    uint64_t now = 0;
+    for (uint32_t address : test_addresses) {
+        caches.data(0x400, address, CACHE_READ, 4, now);
+        now += 10;
+    }
+    const PrefetchStats& stats = caches.getDPrefetchStats();
+    bool test = caches.getDCache().getMisses() == misses && stats.useful == useful && stats.late == 0;
+    cout << "Test " << test_num << " Prefetch: " << (test ? "Passed" : "Failed") << endl;
+}
+
+void test_sharded(int test_num, CacheConfig config, bool sharded) {
+    std::mt19937 random(test_num);
+    std::vector<CacheAccess> accesses;
+    for (int i = 0; i < 20000; i++) {
+        accesses.push_back({uint32_t(random() % 8192) & ~3u, random() % 4 ? CACHE_READ : CACHE_WRITE});
+    }
+
+    Cache cache(config, D_CACHE);
+    for (const CacheAccess& access : accesses) cache.access(access.address, access.op);
+    ThreadPool pool(4);
+    ShardedReplay replay(config, pool);
+    ReplayStats stats = replay.run(accesses);
+    bool test = replay.isSharded() == sharded && stats.hits == cache.getHits() && stats.misses == cache.getMisses() && stats.writebacks == cache.getWritebacks();
+    cout << "Test " << test_num << " Sharded " << replacementPolicyName(config.policy) << ": " << (test ? "Passed" : "Failed") << endl;
+}
+
+void test_copy(int test_num, ReplacementPolicy policy) {
+    CacheConfigSet configs;
+    configs.icConfig = {256, 16, 2, 5};
+    configs.dcConfig = {256, 16, 2, 5};
+    configs.dcConfig.policy = policy;
+    configs.dcConfig.prefetcher = PREFETCH_STREAM;
+    configs.l2Config = {1024, 16, 4, 10};
+    configs.l2Config.policy = policy;
+    std::mt19937 random(test_num);
+    std::vector<uint32_t> addresses;
+    for (int i = 0; i < 4000; i++) addresses.push_back(uint32_t(random() % 8192) & ~3u);
+
+    // a copy taken halfway through goes on exactly like the original
+    CacheHierarchy caches(configs);
+    for (size_t i = 0; i < addresses.size() / 2; i++) caches.data(0x400, addresses[i], CACHE_READ, 4, i);
+    CacheHierarchy copy(caches);
+    uint32_t delays[2] = {0, 0};
+    for (size_t i = addresses.size() / 2; i < addresses.size(); i++) {
+        delays[0] += caches.data(0x400, addresses[i], i % 3 ? CACHE_READ : CACHE_WRITE, 4, i);
+        delays[1] += copy.data(0x400, addresses[i], i % 3 ? CACHE_READ : CACHE_WRITE, 4, i);
+    }
+    bool test = delays[0] == delays[1] && caches.getDCache().getHits() == copy.getDCache().getHits() && caches.getL2()->getMisses() == copy.getL2()->getMisses() && caches.getDPrefetchStats().useful == copy.getDPrefetchStats().useful;
+    cout << "Test " << test_num << " Copy " << replacementPolicyName(policy) << ": " << (test ? "Passed" : "Failed") << endl;
+}
+
 int main(int argc, char** argv) {
     // Tests also check that writes have the exact same behavior
 
@@ -60,5 +164,45 @@ int main(int argc, char** argv) {
     vector<uint32_t> test4 = {0b000, 0b100, 0b1000, 0b1100, 0b10000, 0b10100, 0b000, 0b100};
     test_cache(4, 16, 4, 2, 0, 8, test4);
 
+    // Test that FIFO evicts the oldest fill even when it was just used, where LRU keeps it
+    vector<uint32_t> test5 = {0b000, 0b100, 0b000, 0b1000, 0b000};
+    test_cache(5, 8, 4, 2, 2, 3, test5);
+    test_cache(6, 8, 4, 2, 1, 4, test5, REPLACE_FIFO);
+
+    // Test that only dirty lines are written back, a whole block each, while write-through
+    // sends every store (2 bytes here) and never allocates on a write miss
+    vector<pair<uint32_t, CacheOperation>> test7 = {{0b000, CACHE_WRITE}, {0b1000, CACHE_READ}, {0b000, CACHE_READ}, {0b1000, CACHE_READ}, {0b000, CACHE_WRITE}};
+    test_writebacks(7, WRITE_BACK, 1, 4, test7);
+    test_writebacks(8, WRITE_THROUGH, 2, 4, test7);
+
+    // Test that an inclusive L2 evicting a line drops it from L1, a non-inclusive one does not
+    vector<uint32_t> test9 = {0b000, 0b100, 0b000};
+    test_inclusion(9, true, 0, test9);
+    test_inclusion(10, false, 1, test9);
+
+    // Test that next-line runs ahead of a sequential walk, and stride locks on after two strides
+    vector<uint32_t> test11 = {0b0000, 0b0100, 0b1000, 0b1100};
+    test_prefetch(11, PREFETCH_NEXT_LINE, 1, 3, test11);
+    vector<uint32_t> test12 = {0b000000, 0b001000, 0b010000, 0b011000, 0b100000};
+    test_prefetch(12, PREFETCH_STRIDE, 3, 2, test12);
+
+    // Test that a set-sharded replay adds up to a serial one, and that Random, BRRIP and
+    // a set count that is not a power of two take the serial fallback
+    for (ReplacementPolicy policy : {REPLACE_LRU, REPLACE_PLRU, REPLACE_SRRIP, REPLACE_FIFO, REPLACE_BRRIP, REPLACE_RANDOM}) {
+        CacheConfig config = {1024, 16, 4, 0};
+        config.policy = policy;
+        test_sharded(13, config, policy != REPLACE_BRRIP && policy != REPLACE_RANDOM);
+    }
+    test_sharded(13, CacheConfig{1536, 16, 4, 0}, false);
+
+    // Test that a copied hierarchy, prefetcher and random state included, matches the original
+    for (ReplacementPolicy policy : {REPLACE_LRU, REPLACE_BRRIP, REPLACE_RANDOM}) {
+        test_copy(14, policy);
+    }
+
+    // Test that a dirty L1 line dropped by an inclusive L2 is written to the L3 below it
+    test_inclusive_writeback(15, true, 1);
+    test_inclusive_writeback(16, false, 0);
+
     return 0;
 }
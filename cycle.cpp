@@ -10,29 +10,15 @@
 #include <memory>
 #include <string>
 
+#include "CacheHierarchy.h"
 #include "Utilities.h"
 #include "cache.h"
 #include "cycle.h"
 #include "emulator.h"
 
-static Emulator *emulator = nullptr;
-static Cache *iCache = nullptr;
-static Cache *dCache = nullptr;
-static std::string output;
-
-static PipeState pipeState = {
-    0,
-};
-static uint32_t cycleCount;
-static uint32_t iMiss = 0;  // cycle delays for icache misses
-static uint32_t dMiss = 0;  // cycle delays for dcache misses
-static uint32_t dStall = 0; // load-branches (they insert at d)
-static uint32_t xStall = 0; // load-op and op-branch (they insert at x)
-static uint32_t except = 0; // for exceptions, duh.
-
-static std::array<int, 5> memAddresses{0, 0, 0, 0,
-                                       0}; // for proper load/store tracking
-
+// the simulator behind the free functions in cycle.h
+static std::unique_ptr<CycleSimulator> simulator;
+static PipeTraceFormat defaultTraceFormat = PIPE_TRACE_TEXT;
 
 // gross stack of header funcions for all the helpers
 uint32_t extract(uint32_t instruction, int start, int end);
@@ -46,38 +32,95 @@ bool isLoad(uint32_t target);
 bool isBranch(uint32_t target);
 bool isStore(uint32_t target);
 bool isOp(uint32_t target);
+uint32_t storeSize(uint32_t target);
 bool isImm(uint32_t target);
 bool isRop(uint32_t target);
 
-void ingestPipeline(uint32_t target);
-void ingestBuffer(uint32_t target);
-void dump();
-
 int op_branch(uint32_t use, uint32_t dep);
 int load_branch(uint32_t use, uint32_t dep);
 int load_op(uint32_t use, uint32_t dep);
 
-void printBuffer();
-void printCycle();
-void println(string x);
+void setPipeTraceFormat(PipeTraceFormat format) { defaultTraceFormat = format; }
+
+Status initSimulator(CacheConfig &iCacheConfig, CacheConfig &dCacheConfig,
+                     MemoryStore *mem, const std::string &output_name) {
+  simulator.reset(new CycleSimulator());
+  simulator->setPipeTraceFormat(defaultTraceFormat);
+  simulator->setCheckpointInterval(getCheckpointInterval());
+  return simulator->init(iCacheConfig, dCacheConfig, mem, output_name);
+}
+
+Status initSimulator(const CacheConfigSet &cacheConfigs, MemoryStore *mem,
+                     const std::string &output_name, uint32_t entry) {
+  simulator.reset(new CycleSimulator());
+  simulator->setPipeTraceFormat(defaultTraceFormat);
+  simulator->setCheckpointInterval(getCheckpointInterval());
+  return simulator->init(cacheConfigs, mem, output_name, entry);
+}
+
+Status restoreSimulator(const std::string &checkpoint) {
+  return simulator->loadCheckpoint(checkpoint);
+}
+
+Status fastForwardSimulator(uint32_t instructions, uint32_t targetPc,
+                            bool warmCaches, uint32_t &executed) {
+  return simulator->fastForward(instructions, targetPc, warmCaches, executed);
+}
+
+Status runCycles(uint32_t cycles) { return simulator->runCycles(cycles); }
+
+Status runTillHalt() { return simulator->runTillHalt(); }
+
+Status finalizeSimulator() { return simulator->finalize(); }
+
+CycleSimulator::CycleSimulator()
+    : traceFormat(PIPE_TRACE_TEXT), outputFiles(true), checkpointInterval(0),
+      nextCheckpoint(0), pipeState{0}, cycleCount(0), startDin(0), startCycle(0),
+      iMiss(0),
+      dMiss(0), dStall(0), xStall(0), except(0), memAddresses{0, 0, 0, 0, 0}, memPcs{0, 0, 0, 0, 0} {}
+
+CycleSimulator::~CycleSimulator() {
+  pipeWriter.close();
+  traceWriter.close();
+}
 
 /**
  * Cycle behavior entirely implemented by yours truly, Jackie Liu <3
  */
-Status initSimulator(CacheConfig &iCacheConfig, CacheConfig &dCacheConfig,
-                     MemoryStore *mem, const std::string &output_name) {
+Status CycleSimulator::init(CacheConfig &iCacheConfig,
+                            CacheConfig &dCacheConfig, MemoryStore *mem,
+                            const std::string &output_name, uint32_t entry) {
+  CacheConfigSet cacheConfigs;
+  cacheConfigs.icConfig = iCacheConfig;
+  cacheConfigs.dcConfig = dCacheConfig;
+  return init(cacheConfigs, mem, output_name, entry);
+}
+
+Status CycleSimulator::init(const CacheConfigSet &cacheConfigs,
+                            MemoryStore *mem, const std::string &output_name,
+                            uint32_t entry) {
   output = output_name;
-  emulator = new Emulator();
+  Status status = SUCCESS;
+  if (!outputFiles) {
+    // no pipe state file
+  } else if (traceFormat == PIPE_TRACE_BINARY) {
+    status = traceWriter.open(output);
+  } else {
+    status = pipeWriter.open(output);
+  }
+  emulator.reset(new Emulator());
   emulator->setMemory(mem);
-  iCache = new Cache(iCacheConfig, I_CACHE);
-  dCache = new Cache(dCacheConfig, D_CACHE);
-  return SUCCESS;
+  emulator->setPC(entry);
+  if (checkpointInterval > 0)
+    nextCheckpoint = checkpointInterval;
+  caches.reset(new CacheHierarchy(cacheConfigs));
+  return status;
 }
 
 // run the emulator for a certain number of cycles
 // return SUCCESS if reaching desired cycles.
 // return HALT if the simulator halts on 0xfeedfeed
-Status runCycles(uint32_t cycles) {
+Status CycleSimulator::runCycles(uint32_t cycles) {
   uint32_t count = 0;
   auto status = SUCCESS;
 
@@ -114,6 +157,8 @@ Status runCycles(uint32_t cycles) {
           memAddresses[4] = memAddresses[3];
           memAddresses[3] = memAddresses[2];
           memAddresses[2] = -1;
+          memPcs[4] = memPcs[3];
+          memPcs[3] = memPcs[2];
         } else if (dStall > 0 || iMiss > 0) {
           pipeState.wbInstr = pipeState.memInstr;
           pipeState.memInstr = pipeState.exInstr;
@@ -124,6 +169,9 @@ Status runCycles(uint32_t cycles) {
           memAddresses[3] = memAddresses[2];
           memAddresses[2] = memAddresses[1];
           memAddresses[1] = -1;
+          memPcs[4] = memPcs[3];
+          memPcs[3] = memPcs[2];
+          memPcs[2] = memPcs[1];
         }
       } else {
         // can safely wipe this (exits pipeline)
@@ -142,19 +190,16 @@ Status runCycles(uint32_t cycles) {
       if (iMiss > 0 || dStall > 0 || xStall > 0) {
         // we check data here as well ?
         if (isLoad(pipeState.memInstr) && memAddresses[3] != -1) {
-          dMiss += dCache->access(memAddresses[3], CACHE_READ)
-                       ? 0
-                       : dCache->config.missLatency;
+          dMiss += caches->data(memPcs[3], memAddresses[3], CACHE_READ, 4, cycleCount);
         }
 
         if (isStore(pipeState.memInstr) && memAddresses[3] != -1) {
-          dMiss += dCache->access(memAddresses[3], CACHE_WRITE)
-                       ? 0
-                       : dCache->config.missLatency;
+          dMiss += caches->data(memPcs[3], memAddresses[3], CACHE_WRITE,
+                               storeSize(pipeState.memInstr), cycleCount);
         }
 
         if (dMiss > 0) {
-          println("d-cache miss in stall");
+          TRACE_DEBUG(TRACE_PIPELINE, "d-cache miss in stall");
         }
       }
 
@@ -173,7 +218,7 @@ Status runCycles(uint32_t cycles) {
       except = 2;
       ingestPipeline(0);
       ingestBuffer(-1);
-      println("arithmetic error");
+      TRACE_DEBUG(TRACE_PIPELINE, "arithmetic error");
 
       count++;
       continue;
@@ -182,7 +227,7 @@ Status runCycles(uint32_t cycles) {
       except = 1;
       ingestPipeline(0);
       ingestBuffer(-1);
-      println("illegal");
+      TRACE_DEBUG(TRACE_PIPELINE, "illegal");
 
       count++;
       continue;
@@ -194,7 +239,8 @@ Status runCycles(uint32_t cycles) {
     // note: only valid instructions will pass this stage
     ingestBuffer(isLoad(info.instruction)    ? info.loadAddress
                  : isStore(info.instruction) ? info.storeAddress
-                                             : -1);
+                                             : -1,
+                 info.pc);
 
     /**
      * Cache delays
@@ -203,27 +249,23 @@ Status runCycles(uint32_t cycles) {
      * for dCache, we probably have to look ahead a bit
      */
 
-    iMiss =
-        iCache->access(info.pc, CACHE_READ) ? 0 : iCache->config.missLatency;
+    iMiss = caches->fetch(info.pc, cycleCount);
 
     if (isLoad(pipeState.memInstr) && memAddresses[3] != -1) {
-      dMiss += dCache->access(memAddresses[3], CACHE_READ)
-                   ? 0
-                   : dCache->config.missLatency;
+      dMiss += caches->data(memPcs[3], memAddresses[3], CACHE_READ, 4, cycleCount);
     }
 
     if (isStore(pipeState.memInstr) && memAddresses[3] != -1) {
-      dMiss += dCache->access(memAddresses[3], CACHE_WRITE)
-                   ? 0
-                   : dCache->config.missLatency;
+      dMiss += caches->data(memPcs[3], memAddresses[3], CACHE_WRITE,
+                               storeSize(pipeState.memInstr), cycleCount);
     }
 
     if (iMiss > 0) {
-      println("i-cache miss");
+      TRACE_DEBUG(TRACE_PIPELINE, "i-cache miss");
     }
 
     if (dMiss > 0) {
-      println("d-cache miss");
+      TRACE_DEBUG(TRACE_PIPELINE, "d-cache miss");
     }
 
     /**
@@ -246,15 +288,15 @@ Status runCycles(uint32_t cycles) {
     if (load_branch(fin, din) == load_branch(fin, xin) &&
         load_branch(fin, din) == 2) {
       // load-branch overrides load-something-branch
-      println("load-branch detected");
+      TRACE_DEBUG(TRACE_PIPELINE, "load-branch detected");
       dStall = 2;
     } else if (load_branch(fin, din) == 2 || load_branch(fin, xin) == 2) {
       // if load - something - branch, only do 1
       dStall = load_branch(fin, din) + (load_branch(fin, xin) / 2);
       if (dStall == 1) {
-        println("load-smth-branch detected");
+        TRACE_DEBUG(TRACE_PIPELINE, "load-smth-branch detected");
       } else {
-        println("load-branch detected");
+        TRACE_DEBUG(TRACE_PIPELINE, "load-branch detected");
       }
     }
 
@@ -281,29 +323,34 @@ Status runCycles(uint32_t cycles) {
     count++;
   }
 
-  printBuffer();
-  printCycle();
+  TRACE_TRACE(TRACE_PIPELINE, "buffer: " << memAddresses[0] << " | " << memAddresses[1]
+                                          << " | " << memAddresses[2] << " | "
+                                          << memAddresses[3] << " | " << memAddresses[4]);
+  TRACE_TRACE(TRACE_PIPELINE, "cycle: " << cycleCount << " (" << dStall << " | "
+                                         << xStall << " | " << iMiss << " | " << dMiss
+                                         << ")");
   dump();
   cycleCount++;
-  return status;
-}
-
-void dump() { dumpPipeState(pipeState, output); }
 
-void printBuffer() {
-  cout << "buffer: " << memAddresses[0] << " | " << memAddresses[1] << " | "
-       << memAddresses[2] << " | " << memAddresses[3] << " | "
-       << memAddresses[4] << endl;
+  uint32_t din = emulator->getDin();
+  if (checkpointInterval > 0 && status != HALT && din >= nextCheckpoint) {
+    if (saveCheckpoint(checkpointFileName(output, din)) != SUCCESS)
+      return ERROR;
+    nextCheckpoint = nextCheckpointDin(din, checkpointInterval);
+  }
+  return status;
 }
 
-void printCycle() {
-  cout << "cycle: " << cycleCount << " (" << dStall << " | " << xStall << " | "
-       << iMiss << " | " << dMiss << ") " << endl
-       << endl;
+void CycleSimulator::dump() {
+  if (!outputFiles) {
+    return;
+  } else if (traceFormat == PIPE_TRACE_BINARY) {
+    traceWriter.write(pipeState);
+  } else {
+    pipeWriter.write(pipeState);
+  }
 }
 
-void println(string x) { cout << x << endl; }
-
 int op_branch(uint32_t use, uint32_t dep) {
   if (isBranch(use) && isOp(dep)) {
     uint32_t target;
@@ -320,8 +367,8 @@ int op_branch(uint32_t use, uint32_t dep) {
     br_b = rt(use);
 
     if (br_a == target || br_b == target) {
-      println("op-branch detected");
-      cout << br_a << " | " << br_b << " = " << target << endl;
+      TRACE_DEBUG(TRACE_PIPELINE, "op-branch detected: " << br_a << " | " << br_b
+                                                        << " = " << target);
       return 1;
     }
   }
@@ -339,7 +386,8 @@ int load_branch(uint32_t use, uint32_t dep) {
     br_b = rt(use);
 
     if (br_a == target || br_b == target) {
-      cout << br_a << " | " << br_b << " = " << target << endl;
+      TRACE_DEBUG(TRACE_PIPELINE, "load-branch operands: " << br_a << " | " << br_b
+                                                          << " = " << target);
       return 2;
     }
   }
@@ -361,8 +409,8 @@ int load_op(uint32_t use, uint32_t dep) {
 
     if ((imm && op_a == target) ||
         (!imm && (op_a == target || op_b == target))) {
-      println("load-op detected");
-      cout << op_a << " | " << op_b << " = " << target << endl;
+      TRACE_DEBUG(TRACE_PIPELINE, "load-op detected: " << op_a << " | " << op_b
+                                                     << " = " << target);
       return 1;
     }
   }
@@ -370,15 +418,20 @@ int load_op(uint32_t use, uint32_t dep) {
   return 0;
 }
 
-void ingestBuffer(uint32_t in) {
+void CycleSimulator::ingestBuffer(uint32_t in, uint32_t pc) {
   memAddresses[4] = memAddresses[3];
   memAddresses[3] = memAddresses[2];
   memAddresses[2] = memAddresses[1];
   memAddresses[1] = memAddresses[0];
   memAddresses[0] = in;
+  memPcs[4] = memPcs[3];
+  memPcs[3] = memPcs[2];
+  memPcs[2] = memPcs[1];
+  memPcs[1] = memPcs[0];
+  memPcs[0] = pc;
 }
 
-void ingestPipeline(uint32_t in) {
+void CycleSimulator::ingestPipeline(uint32_t in) {
   pipeState.cycle = cycleCount;
   pipeState.wbInstr = pipeState.memInstr;
   pipeState.memInstr = pipeState.exInstr;
@@ -389,27 +442,180 @@ void ingestPipeline(uint32_t in) {
 
 // run till halt (call runCycles() with cycles == 1 each time) until
 // status tells you to HALT or ERROR out
-Status runTillHalt() {
+Status CycleSimulator::runTillHalt() {
   Status status;
   while (true) {
     status = static_cast<Status>(runCycles(1));
-    if (status == HALT)
+    if (status == HALT || status == ERROR)
       break;
   }
   return status;
 }
 
 // dump the state of the emulator
-Status finalizeSimulator() {
+Status CycleSimulator::finalize() {
+  pipeWriter.close();
+  traceWriter.close();
+  if (!outputFiles)
+    return SUCCESS;
   emulator->dumpRegMem(output);
-  SimulationStats stats{
-      emulator->getDin(),
-      cycleCount,
-  }; // TODO incomplete implementation
+  SimulationStats stats = getStats();
   dumpSimStats(stats, output);
   return SUCCESS;
 }
 
+CycleSimulator::Snapshot CycleSimulator::snapshot() const {
+  Snapshot s;
+  s.emulator = emulator->snapshot();
+  s.caches = std::make_shared<const CacheHierarchy>(*caches);
+  s.pipeState = pipeState;
+  s.cycleCount = cycleCount;
+  s.startDin = startDin;
+  s.startCycle = startCycle;
+  s.iMiss = iMiss;
+  s.dMiss = dMiss;
+  s.dStall = dStall;
+  s.xStall = xStall;
+  s.except = except;
+  s.memAddresses = memAddresses;
+  s.memPcs = memPcs;
+  return s;
+}
+
+void CycleSimulator::restore(const Snapshot &s, bool keepCaches) {
+  emulator->restore(s.emulator);
+  if (!keepCaches) caches.reset(new CacheHierarchy(*s.caches));
+  pipeState = s.pipeState;
+  cycleCount = s.cycleCount;
+  startDin = s.startDin;
+  startCycle = s.startCycle;
+  iMiss = s.iMiss;
+  dMiss = s.dMiss;
+  dStall = s.dStall;
+  xStall = s.xStall;
+  except = s.except;
+  memAddresses = s.memAddresses;
+  memPcs = s.memPcs;
+}
+
+Status CycleSimulator::fastForward(uint32_t instructions, uint32_t targetPc,
+                                   bool warmCaches, uint32_t &executed) {
+  MemoryStore *memory = emulator->getMemory();
+  uint64_t now = 0;
+  executed = 0;
+  while (instructions == 0 || executed < instructions) {
+    uint32_t pc = emulator->getPC();
+    uint32_t next;
+    if (pc == targetPc || (memory->read32(pc, next) && next == 0xfeedfeed))
+      break;
+
+    Emulator::InstructionInfo info = emulator->executeInstruction();
+    executed++;
+    if (!warmCaches || !info.isValid || info.isOverflow)
+      continue;
+
+    // what sim_cycle sends the caches: whole words for loads, the stored bytes
+    caches->fetch(info.pc, now);
+    switch (info.opcode) {
+    case OP_LBU:
+    case OP_LHU:
+    case OP_LW:
+      caches->data(info.pc, info.loadAddress, CACHE_READ, 4, now);
+      break;
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+      caches->data(info.pc, info.storeAddress, CACHE_WRITE,
+                   storeSize(info.instruction), now);
+      break;
+    }
+    now++;
+  }
+
+  if (warmCaches)
+    caches->endWarmup();
+  // the pipeline refills from the current PC
+  pipeState = PipeState{0};
+  iMiss = dMiss = dStall = xStall = except = 0;
+  memAddresses = {0, 0, 0, 0, 0};
+  memPcs = {0, 0, 0, 0, 0};
+  startDin = emulator->getDin();
+  startCycle = cycleCount;
+  if (checkpointInterval > 0)
+    nextCheckpoint = nextCheckpointDin(startDin, checkpointInterval);
+  return SUCCESS;
+}
+
+Status CycleSimulator::saveCheckpoint(const std::string &fileName) const {
+  CheckpointWriter out;
+  if (out.open(fileName, CHECKPOINT_CYCLE) != SUCCESS)
+    return ERROR;
+  emulator->save(out);
+  caches->save(out);
+  out.section("PIPE");
+  out.put(pipeState);
+  out.put(cycleCount);
+  out.put(startDin);
+  out.put(startCycle);
+  out.put(iMiss);
+  out.put(dMiss);
+  out.put(dStall);
+  out.put(xStall);
+  out.put(except);
+  out.put(memAddresses);
+  out.put(memPcs);
+  return out.close();
+}
+
+Status CycleSimulator::loadCheckpoint(const std::string &fileName) {
+  CheckpointReader in;
+  if (in.open(fileName) != SUCCESS || emulator->load(in) != SUCCESS)
+    return ERROR;
+  if (in.getKind() == CHECKPOINT_CYCLE) {
+    bool ok = caches->load(in) && in.section("PIPE") && in.get(pipeState) &&
+              in.get(cycleCount) && in.get(startDin) &&
+              in.get(startCycle) && in.get(iMiss) &&
+              in.get(dMiss) &&
+              in.get(dStall) && in.get(xStall) && in.get(except) &&
+              in.get(memAddresses) && in.get(memPcs);
+    if (!ok)
+      return ERROR;
+  } else {
+    startDin = emulator->getDin();
+    startCycle = cycleCount;
+  }
+  if (checkpointInterval > 0)
+    nextCheckpoint = nextCheckpointDin(emulator->getDin(), checkpointInterval);
+  return SUCCESS;
+}
+
+SimulationStats CycleSimulator::getStats() const {
+  SimulationStats stats{emulator->getDin() - startDin, cycleCount - startCycle};
+  stats.icHits = caches->getICache().getHits();
+  stats.icMisses = caches->getICache().getMisses();
+  stats.dcHits = caches->getDCache().getHits();
+  stats.dcMisses = caches->getDCache().getMisses();
+  if (const Cache *l2 = caches->getL2()) {
+    stats.l2Hits = l2->getHits();
+    stats.l2Misses = l2->getMisses();
+  }
+  if (const Cache *l3 = caches->getL3()) {
+    stats.l3Hits = l3->getHits();
+    stats.l3Misses = l3->getMisses();
+  }
+  stats.writebacks = caches->getDCache().getWritebacks();
+  stats.writebackBytes = caches->getDCache().getWritebackBytes();
+  const PrefetchStats &iPrefetch = caches->getIPrefetchStats();
+  stats.icPrefetches = iPrefetch.issued;
+  stats.icPrefetchesUseful = iPrefetch.useful;
+  stats.icPrefetchesLate = iPrefetch.late;
+  const PrefetchStats &dPrefetch = caches->getDPrefetchStats();
+  stats.dcPrefetches = dPrefetch.issued;
+  stats.dcPrefetchesUseful = dPrefetch.useful;
+  stats.dcPrefetchesLate = dPrefetch.late;
+  return stats;
+}
+
 uint32_t extract(uint32_t instruction, int start, int end) {
   int bitsToExtract = start - end + 1;
   uint32_t mask = (1 << bitsToExtract) - 1;
@@ -449,6 +655,17 @@ bool isStore(uint32_t target) {
   return op == OP_SB || op == OP_SH || op == OP_SW;
 }
 
+uint32_t storeSize(uint32_t target) {
+  switch (opcode(target)) {
+  case OP_SB:
+    return 1;
+  case OP_SH:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
 bool isOp(uint32_t target) {
   if (target == 0)
     return false;
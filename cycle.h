@@ -1,15 +1,139 @@
 #pragma once
+#include <array>
+#include <memory>
 #include <string>
 
+#include "CacheHierarchy.h"
+#include "Checkpoint.h"
+#include "PipeStateWriter.h"
+#include "PipeTrace.h"
 #include "cache.h"
 #include "Utilities.h"
 #include "emulator.h"
 #include "stdint.h"
 
+enum PipeTraceFormat {
+    PIPE_TRACE_TEXT,    // <output>_pipe_state.out
+    PIPE_TRACE_BINARY,  // <output>_pipe_trace.bin, see PipeTrace.h and pipe_render
+};
+
+// One cycle-accurate simulation: the emulator, both caches, the pipeline and its
+// output files. Independent instances can run side by side, on different threads too.
+class CycleSimulator {
+   public:
+    CycleSimulator();
+    ~CycleSimulator();
+    CycleSimulator(const CycleSimulator&) = delete;
+    CycleSimulator& operator=(const CycleSimulator&) = delete;
+
+    // pick how the per-cycle pipe state is recorded, call before init()
+    void setPipeTraceFormat(PipeTraceFormat format) { traceFormat = format; }
+    // when off, nothing is written: no pipe state, no reg/mem dump, no sim stats
+    void setOutputFiles(bool enabled) { outputFiles = enabled; }
+    // write a checkpoint at the end of the cycle in which din reaches a multiple of
+    // instructions, 0 for never
+    void setCheckpointInterval(uint32_t instructions) { checkpointInterval = instructions; }
+
+    // takes ownership of memory, the emulator deletes it; execution starts at entry
+    Status init(CacheConfig& icConfig, CacheConfig& dcConfig, MemoryStore* memory,
+                const std::string& output_name, uint32_t entry = 0);
+    // the same with the L2 and L3 of the config set, if any
+    Status init(const CacheConfigSet& cacheConfigs, MemoryStore* memory,
+                const std::string& output_name, uint32_t entry = 0);
+    Status runCycles(uint32_t cycles);
+    Status runTillHalt();
+    Status finalize();
+
+    // Runs up to instructions (0 for no limit) functionally, with no pipeline, stopping
+    // early before the instruction at targetPc (NO_TARGET_PC for none) or a halt, so the
+    // cycle model always gets to run the end of the program. With warmCaches every
+    // fetch, load and store goes through the caches in order, as in sim_cycle but one
+    // cycle each, and the counters are zeroed afterwards. Call after init(), or
+    // loadCheckpoint(), and before runCycles(). The pipeline starts out empty, so what
+    // a cycle checkpoint had in flight counts as skipped, and the stats from then on
+    // only cover the cycle-accurate part.
+    static const uint32_t NO_TARGET_PC = ~0u;
+    Status fastForward(uint32_t instructions, uint32_t targetPc, bool warmCaches,
+                       uint32_t& executed);
+
+    // din and cycles since the start or the last fastForward(), plus the hit/miss counts of every cache level and D-cache writebacks
+    SimulationStats getStats() const;
+
+    // Everything a run has built up at one point: the emulator with its memory (shared
+    // copy-on-write, see Emulator::Snapshot), the caches and the pipeline. One snapshot
+    // can be restored into any number of simulators, on different threads too.
+    struct Snapshot {
+        Emulator::Snapshot emulator;
+        std::shared_ptr<const CacheHierarchy> caches;
+        PipeState pipeState;
+        uint32_t cycleCount;
+        uint32_t startDin, startCycle;
+        uint32_t iMiss, dMiss, dStall, xStall, except;
+        std::array<int, 5> memAddresses;
+        std::array<uint32_t, 5> memPcs;
+    };
+    // both after init()
+    Snapshot snapshot() const;
+    // With keepCaches, the caches stay the ones this simulator has, e.g. a fresh init()
+    // with another configuration, to explore it from the snapshot's point on.
+    void restore(const Snapshot& snapshot, bool keepCaches = false);
+
+    // The same in a checkpoint file, after init(). The caches must be configured as
+    // they were when it was written. A functional checkpoint leaves the caches and the
+    // pipeline as init() set them up, and cycles count from there.
+    Status saveCheckpoint(const std::string& fileName) const;
+    Status loadCheckpoint(const std::string& fileName);
+
+   private:
+    void ingestPipeline(uint32_t in);
+    void ingestBuffer(uint32_t in, uint32_t pc = 0);
+    void dump();
+
+    std::unique_ptr<Emulator> emulator;
+    std::unique_ptr<CacheHierarchy> caches;
+    std::string output;
+    PipeTraceFormat traceFormat;
+    bool outputFiles;
+    PipeStateWriter pipeWriter;
+    PipeTraceWriter traceWriter;
+    uint32_t checkpointInterval;
+    uint32_t nextCheckpoint;  // din of the next one
+
+    PipeState pipeState;
+    uint32_t cycleCount;
+    uint32_t startDin;    // din when the cycle-accurate part began
+    uint32_t startCycle;  // and cycleCount
+    uint32_t iMiss;   // cycle delays for icache misses
+    uint32_t dMiss;   // cycle delays for dcache misses
+    uint32_t dStall;  // load-branches (they insert at d)
+    uint32_t xStall;  // load-op and op-branch (they insert at x)
+    uint32_t except;  // for exceptions, duh.
+
+    std::array<int, 5> memAddresses;  // for proper load/store tracking
+    std::array<uint32_t, 5> memPcs;   // pc of each, for the stride prefetcher
+};
+
+// The free functions below drive one process-wide CycleSimulator.
+
+// pick how the per-cycle pipe state is recorded, call before initSimulator()
+void setPipeTraceFormat(PipeTraceFormat format);
+
 // init the emulator and all info
 Status initSimulator(CacheConfig& icConfig, CacheConfig& dcConfig, MemoryStore* memory,
                      const std::string& output_name);
 
+// the same with the L2 and L3 of the config set, if any, starting at entry
+Status initSimulator(const CacheConfigSet& cacheConfigs, MemoryStore* memory,
+                     const std::string& output_name, uint32_t entry = 0);
+
+// continue from a checkpoint file, after initSimulator()
+Status restoreSimulator(const std::string& checkpoint);
+
+// run functionally up to instructions or targetPc first, see
+// CycleSimulator::fastForward(); after initSimulator() or restoreSimulator()
+Status fastForwardSimulator(uint32_t instructions, uint32_t targetPc, bool warmCaches,
+                            uint32_t& executed);
+
 // run the emulator for a certain number of cycles
 Status runCycles(uint32_t cycles);
 
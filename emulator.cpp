@@ -11,6 +11,8 @@
 
 #include <cassert>
 #include <iostream>
+
+#include "Checkpoint.h"
 using namespace std;
 
 Emulator::Emulator() {
@@ -21,10 +23,55 @@ Emulator::Emulator() {
     savedBranch = 0;
     regData.reg = {};
     din = 0;
+    decodeCache.resize(DECODE_CACHE_ENTRIES);
+    blockCache.resize(BLOCK_CACHE_ENTRIES);
+    codeModified = false;
+    jitCode = nullptr;
+    jitCodeUsed = 0;
 }
 
 Emulator::~Emulator() {
     if (memory) delete memory;
+    releaseJit();
+}
+
+Emulator::Snapshot Emulator::snapshot() const {
+    Snapshot s;
+    memcpy(s.registers, regData.registers, sizeof(s.registers));
+    s.PC = PC;
+    s.encounteredBranch = encounteredBranch;
+    s.savedBranch = savedBranch;
+    s.din = din;
+    s.memory = std::make_shared<const MemoryStore>(*memory);
+    return s;
+}
+
+void Emulator::restore(const Snapshot& s) {
+    memcpy(regData.registers, s.registers, sizeof(s.registers));
+    PC = s.PC;
+    encounteredBranch = s.encounteredBranch;
+    savedBranch = s.savedBranch;
+    din = s.din;
+    delete memory;
+    setMemory(new MemoryStore(*s.memory));
+}
+
+void Emulator::save(CheckpointWriter& out) const {
+    out.section("EMU ");
+    out.write(regData.registers, sizeof(regData.registers));
+    out.put(PC);
+    out.put(encounteredBranch);
+    out.put(savedBranch);
+    out.put(din);
+    memory->save(out);
+}
+
+Status Emulator::load(CheckpointReader& in) {
+    bool ok = in.section("EMU ") && in.read(regData.registers, sizeof(regData.registers)) &&
+              in.get(PC) && in.get(encounteredBranch) && in.get(savedBranch) && in.get(din) &&
+              memory->load(in) == 0;
+    flushDecodeCache();
+    return ok ? SUCCESS : ERROR;
 }
 
 // extract specific bits [start, end] from a 32 bit instruction
@@ -49,14 +96,130 @@ void Emulator::dumpRegMem(const std::string& output_name) {
     dumpMemoryState(memory, output_name);
 }
 
+// handler for each OpKind, in enum order
+const Emulator::Handler Emulator::handlers[NUM_OP_KINDS] = {
+    &Emulator::opAdd,  &Emulator::opAddu, &Emulator::opAnd,  &Emulator::opJr,
+    &Emulator::opNor,  &Emulator::opOr,   &Emulator::opSlt,  &Emulator::opSltu,
+    &Emulator::opSll,  &Emulator::opSrl,  &Emulator::opSub,  &Emulator::opSubu,
+    &Emulator::opIllegalFunct,
+    &Emulator::opAddi, &Emulator::opAddiu, &Emulator::opAndi, &Emulator::opBeq,
+    &Emulator::opBne,  &Emulator::opBlez, &Emulator::opBgtz, &Emulator::opJ,
+    &Emulator::opJal,  &Emulator::opLbu,  &Emulator::opLhu,  &Emulator::opLui,
+    &Emulator::opLw,   &Emulator::opOri,  &Emulator::opSlti, &Emulator::opSltiu,
+    &Emulator::opSb,   &Emulator::opSh,   &Emulator::opSw,   &Emulator::opIllegal,
+    &Emulator::opIllegal,  // K_HALT never reaches its handler
+};
+
+// fetch the instruction at pc and decode it, reusing an earlier decode when there is one
+const Emulator::DecodedInstruction& Emulator::fetchDecoded(uint32_t pc,
+                                                           DecodedInstruction& scratch) {
+    DecodedInstruction& entry = decodeCache[(pc >> 2) % DECODE_CACHE_ENTRIES];
+    if (entry.valid && entry.pc == pc) return entry;
+    // a threaded block still points at the entry we're about to replace
+    if (entry.valid && entry.inBlock) codeModified = true;
+
+    uint32_t instruction;
+    if (!memory->read32(pc, instruction)) {
+        // don't cache fetches that faulted, decode them every time
+        decode(instruction, scratch);
+        scratch.pc = pc;
+        return scratch;
+    }
+    decode(instruction, entry);
+    entry.pc = pc;
+    entry.valid = true;
+    entry.inBlock = false;
+    return entry;
+}
+
+// split an instruction into its bit-fields and pick the handler that executes it
+void Emulator::decode(uint32_t instruction, DecodedInstruction& d) {
+    // parse instruction by completing function calls to extractBits() and set operands accordingly
+    d.instruction = instruction;
+    d.opcode = extractBits(instruction, 31, 26);
+    d.rs = extractBits(instruction, 25, 21);
+    d.rt = extractBits(instruction, 20, 16);
+    d.rd = extractBits(instruction, 15, 11);
+    d.shamt = extractBits(instruction, 10, 6);
+    d.funct = extractBits(instruction, 5, 0);
+    d.immediate = extractBits(instruction, 15, 0);
+    d.address = extractBits(instruction, 25, 0);
+
+    d.signExtImm = signExt(d.immediate);
+    d.zeroExtImm = d.immediate;
+    d.branchAddr = d.signExtImm << 2;
+
+    if (instruction == 0xfeedfeed) {
+        d.kind = K_HALT;
+    } else {
+        switch (d.opcode) {
+            case OP_ZERO:  // R-type instruction
+                switch (d.funct) {
+                    case FUN_ADD:  d.kind = K_ADD; break;
+                    case FUN_ADDU: d.kind = K_ADDU; break;
+                    case FUN_AND:  d.kind = K_AND; break;
+                    case FUN_JR:   d.kind = K_JR; break;
+                    case FUN_NOR:  d.kind = K_NOR; break;
+                    case FUN_OR:   d.kind = K_OR; break;
+                    case FUN_SLT:  d.kind = K_SLT; break;
+                    case FUN_SLTU: d.kind = K_SLTU; break;
+                    case FUN_SLL:  d.kind = K_SLL; break;
+                    case FUN_SRL:  d.kind = K_SRL; break;
+                    case FUN_SUB:  d.kind = K_SUB; break;
+                    case FUN_SUBU: d.kind = K_SUBU; break;
+                    default:       d.kind = K_ILLEGAL_FUNCT;
+                }
+                break;
+            case OP_ADDI:  d.kind = K_ADDI; break;
+            case OP_ADDIU: d.kind = K_ADDIU; break;
+            case OP_ANDI:  d.kind = K_ANDI; break;
+            case OP_BEQ:   d.kind = K_BEQ; break;
+            case OP_BNE:   d.kind = K_BNE; break;
+            case OP_BLEZ:  d.kind = K_BLEZ; break;
+            case OP_BGTZ:  d.kind = K_BGTZ; break;
+            case OP_J:     d.kind = K_J; break;
+            case OP_JAL:   d.kind = K_JAL; break;
+            case OP_LBU:   d.kind = K_LBU; break;
+            case OP_LHU:   d.kind = K_LHU; break;
+            case OP_LUI:   d.kind = K_LUI; break;
+            case OP_LW:    d.kind = K_LW; break;
+            case OP_ORI:   d.kind = K_ORI; break;
+            case OP_SLTI:  d.kind = K_SLTI; break;
+            case OP_SLTIU: d.kind = K_SLTIU; break;
+            case OP_SB:    d.kind = K_SB; break;
+            case OP_SH:    d.kind = K_SH; break;
+            case OP_SW:    d.kind = K_SW; break;
+            default:       d.kind = K_ILLEGAL;
+        }
+    }
+    d.handler = handlers[d.kind];
+}
+
+// a store may overwrite code we've already decoded, so drop any cached instruction
+// whose four bytes overlap [address, address + size)
+void Emulator::invalidateDecoded(uint32_t address, uint32_t size) {
+    for (uint32_t pc = address - 3; pc != address + size; pc++) {
+        DecodedInstruction& entry = decodeCache[(pc >> 2) % DECODE_CACHE_ENTRIES];
+        if (entry.valid && entry.pc == pc) {
+            entry.valid = false;
+            if (entry.inBlock) codeModified = true;
+        }
+    }
+}
+
+void Emulator::flushDecodeCache() {
+    for (auto& entry : decodeCache) entry.valid = false;
+    flushBlocks();
+}
+
 Emulator::InstructionInfo Emulator::executeInstruction() {
     assert(memory);
     InstructionInfo info;  // information struct for this instruction
     info.pc = PC;          // fill PC before its updated
 
-    uint32_t instruction;
-    memory->getMemValue(PC, instruction, WORD_SIZE);
-    info.instruction = instruction;
+    DecodedInstruction scratch;
+    const DecodedInstruction& d = fetchDecoded(PC, scratch);
+    info.instruction = d.instruction;
 
     // increment PC & reset zero register
     info.nextPC = (encounteredBranch) ? savedBranch : PC + 4;
@@ -72,217 +235,221 @@ Emulator::InstructionInfo Emulator::executeInstruction() {
     din += 1;
 
     // check for halt instruction and return immediately
-    info.isHalt = (instruction == 0xfeedfeed);
-    if (instruction == 0xfeedfeed) {
+    info.isHalt = (d.instruction == 0xfeedfeed);
+    if (d.instruction == 0xfeedfeed) {
         return info;
     }
 
-    // parse instruction by completing function calls to extractBits() and set operands accordingly
-    uint32_t opcode = extractBits(instruction, 31, 26);
-    uint32_t rs = extractBits(instruction, 25, 21);
-    uint32_t rt = extractBits(instruction, 20, 16);
-    uint32_t rd = extractBits(instruction, 15, 11);
-    uint32_t shamt = extractBits(instruction, 10, 6);
-    uint32_t funct = extractBits(instruction, 5, 0);
-    uint16_t immediate = extractBits(instruction, 15, 0);
-    uint32_t address = extractBits(instruction, 25, 0);
+    // fill the bitfields in the instruction info struct
+    info.opcode = d.opcode;
+    info.rs = d.rs;
+    info.rt = d.rt;
+    info.rd = d.rd;
+    info.shamt = d.shamt;
+    info.funct = d.funct;
+    info.immediate = d.immediate;
+    info.address = d.address;
+    info.signExtImm = d.signExtImm;
+    info.zeroExtImm = d.zeroExtImm;
+    info.branchAddr = d.branchAddr;
+    info.jumpAddr = (PC & 0xf0000000) ^ (d.address << 2);  // assumes PC += 4 just happened
+
+    (this->*d.handler)(d, info);
+    return info;  // return the InstructionInfo struct of the instruction just executed
+}
 
-    int32_t signExtImm = signExt(immediate);
-    uint32_t zeroExtImm = immediate;
+void Emulator::opAdd(const DecodedInstruction& d, InstructionInfo& info) {
+    uint32_t a = regData.registers[d.rs];
+    uint32_t b = regData.registers[d.rt];
+    uint32_t sum = a + b;
+    // signed overflow iff both operands have the same sign and the sum doesn't
+    bool overflow = ((a ^ sum) & (b ^ sum)) >> 31;
+    TRACE_TRACE(TRACE_EMULATOR, "add " << int32_t(a) << " + " << int32_t(b) << " = "
+                                       << int32_t(sum) << ", " << LOG_VAR(overflow));
+    if (overflow) {
+        info.isOverflow = true;
+        PC = 0x8000;
+    } else {
+        regData.registers[d.rd] = sum;
+    }
+}
 
-    uint32_t branchAddr = signExtImm << 2;
-    uint32_t jumpAddr = (PC & 0xf0000000) ^ (address << 2);  // assumes PC += 4 just happened
+void Emulator::opAddu(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rs] + regData.registers[d.rt];
+}
 
-    // fill the bitfields in the instruction info struct
-    info.opcode = opcode;
-    info.rs = rs;
-    info.rt = rt;
-    info.rd = rd;
-    info.shamt = shamt;
-    info.funct = funct;
-    info.immediate = immediate;
-    info.address = address;
-    info.signExtImm = signExtImm;
-    info.zeroExtImm = zeroExtImm;
-    info.branchAddr = branchAddr;
-    info.jumpAddr = jumpAddr;
-
-    int32_t a, b;
-
-    switch (opcode) {
-        case OP_ZERO:  // R-type instruction
-            switch (funct) {
-                case FUN_ADD:
-                    a = regData.registers[rs];
-                    b = regData.registers[rt];
-                    cout << a << endl;
-                    cout << b << endl;
-                    cout << (a + b) << endl;
-                    cout << ((a > 0 && b > 0 && a + b < 0) || (a < 0 && b < 0 && a + b > 0)) << endl;
-                    if(((a >= 0) && (b >= 0) && (a+b < 0)) || ((a < 0) && (b < 0) && (a+b >= 0))){
-                        info.isOverflow = true;
-                        PC = 0x8000;
-                        break;
-                    }
-                    else{
-                        regData.registers[rd] = regData.registers[rs] + regData.registers[rt];
-                        break;
-                    }
-                case FUN_ADDU:
-                    regData.registers[rd] = regData.registers[rs] + regData.registers[rt];
-                    break;
-                case FUN_AND:
-                    regData.registers[rd] = regData.registers[rs] & regData.registers[rt];
-                    break;
-                case FUN_JR:
-                    encounteredBranch = true;
-                    savedBranch = regData.registers[rs];
-                    break;
-                case FUN_NOR:
-                    regData.registers[rd] = ~(regData.registers[rs] | regData.registers[rt]);
-                    break;
-                case FUN_OR:
-                    regData.registers[rd] = regData.registers[rs] | regData.registers[rt];
-                    break;
-                case FUN_SLT:
-                    regData.registers[rd] =
-                        (int32_t(regData.registers[rs]) < int32_t(regData.registers[rt])) ? 1 : 0;
-                    break;
-                case FUN_SLTU:
-                    regData.registers[rd] = (regData.registers[rs] < regData.registers[rt]) ? 1 : 0;
-                    break;
-                case FUN_SLL:
-                    regData.registers[rd] = regData.registers[rt] << shamt;
-                    break;
-                case FUN_SRL:
-                    regData.registers[rd] = regData.registers[rt] >> shamt;
-                    break;
-                case FUN_SUB:
-                    regData.registers[rd] = regData.registers[rs] - regData.registers[rt];
-                    break;
-                case FUN_SUBU:
-                    a = regData.registers[rs];
-                    b = regData.registers[rt];
-                    cout << a << endl;
-                    cout << b << endl;
-                    cout << (a + b) << endl;
-                    cout << ((a > 0 && b > 0 && a + b < 0) || (a < 0 && b < 0 && a + b > 0)) << endl;
-                    if(((a >= 0) && (b < 0) && (a-b < 0)) || ((a < 0) && (b >= 0) && (a-b >= 0))){
-                        info.isOverflow = true;
-                        PC = 0x8000;
-                        break;
-                    }
-                    else{
-                        regData.registers[rd] = regData.registers[rs] - regData.registers[rt];
-                        break;
-                    }
-                default:
-                    std::cerr << LOG_ERROR << "Illegal operation..." << std::endl;
-                    info.isValid = false;
-            }
-            break;
-
-        case OP_ADDI:
-            a = regData.registers[rs];
-            b = signExtImm;
-            cout << a << endl;
-            cout << b << endl;
-            cout << (a + b) << endl;
-            cout << ((a > 0 && b > 0 && a + b < 0) || (a < 0 && b < 0 && a + b > 0)) << endl;
-            if(((a >= 0) && (b >= 0) && (a+b < 0)) || ((a < 0) && (b < 0) && (a+b >= 0))){
-                info.isOverflow = true;
-                PC = 0x8000;
-                break;
-            }
-            else{
-                regData.registers[rt] = regData.registers[rs] + signExtImm;
-                break;
-            }
-        case OP_ADDIU:
-            regData.registers[rt] = regData.registers[rs] + signExtImm;
-            break;
-        case OP_ANDI:
-            regData.registers[rt] = regData.registers[rs] & zeroExtImm;
-            break;
-        case OP_BEQ:
-            if (regData.registers[rs] == regData.registers[rt]) {
-                encounteredBranch = true;
-                savedBranch = PC + branchAddr;
-            }
-            break;
-        case OP_BNE:
-            if (regData.registers[rs] != regData.registers[rt]) {
-                encounteredBranch = true;
-                savedBranch = PC + branchAddr;
-            }
-            break;
-        case OP_BLEZ:
-            if (regData.registers[rs] == 0 || (regData.registers[rs] & 0x80000000)) {
-                encounteredBranch = true;
-                savedBranch = PC + branchAddr;
-            }
-            break;
-        case OP_BGTZ:
-            if (!(regData.registers[rs] & 0x80000000) && regData.registers[rs] != 0) {
-                encounteredBranch = true;
-                savedBranch = PC + branchAddr;
-            }
-            break;
-        case OP_J:
-            encounteredBranch = true;
-            savedBranch = jumpAddr;
-            break;
-        case OP_JAL:
-            encounteredBranch = true;
-            regData.registers[31] = PC + 4;
-            savedBranch = jumpAddr;
-            break;
-        case OP_LBU:
-            info.loadAddress = regData.registers[rs] + signExtImm;  // capture load address
-            memory->getMemValue(regData.registers[rs] + signExtImm, regData.registers[rt],
-                                BYTE_SIZE);
-            break;
-        case OP_LHU:
-            info.loadAddress = regData.registers[rs] + signExtImm;  // capture load address
-            memory->getMemValue(regData.registers[rs] + signExtImm, regData.registers[rt],
-                                HALF_SIZE);
-            break;
-        case OP_LUI:
-            regData.registers[rt] = zeroExtImm << 16;
-            break;
-        case OP_LW:
-            info.loadAddress = regData.registers[rs] + signExtImm;  // capture load address
-            memory->getMemValue(regData.registers[rs] + signExtImm, regData.registers[rt],
-                                WORD_SIZE);
-            break;
-        case OP_ORI:
-            regData.registers[rt] = regData.registers[rs] | zeroExtImm;
-            break;
-        case OP_SLTI:
-            regData.registers[rt] = (int32_t(regData.registers[rs]) < int32_t(signExtImm)) ? 1 : 0;
-            break;
-        case OP_SLTIU:
-            regData.registers[rt] = (regData.registers[rs] < uint32_t(signExtImm)) ? 1 : 0;
-            break;
-        case OP_SB:
-            info.storeAddress = regData.registers[rs] + signExtImm;  // capture store address
-            memory->setMemValue(regData.registers[rs] + signExtImm,
-                                extractBits(regData.registers[rt], 7, 0), BYTE_SIZE);
-            break;
-        case OP_SH:
-            info.storeAddress = regData.registers[rs] + signExtImm;  // capture store address
-            memory->setMemValue(regData.registers[rs] + signExtImm,
-                                extractBits(regData.registers[rt], 15, 0), HALF_SIZE);
-            break;
-        case OP_SW:
-            info.storeAddress = regData.registers[rs] + signExtImm;  // capture store address
-            memory->setMemValue(regData.registers[rs] + signExtImm, regData.registers[rt],
-                                WORD_SIZE);
-            break;
-        default:
-            std::cerr << LOG_ERROR << "Illegal operation..." << std::endl;
-            PC = 0x8000;
-            info.isValid = false;
+void Emulator::opAnd(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rs] & regData.registers[d.rt];
+}
+
+void Emulator::opJr(const DecodedInstruction& d, InstructionInfo& info) {
+    encounteredBranch = true;
+    savedBranch = regData.registers[d.rs];
+}
+
+void Emulator::opNor(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = ~(regData.registers[d.rs] | regData.registers[d.rt]);
+}
+
+void Emulator::opOr(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rs] | regData.registers[d.rt];
+}
+
+void Emulator::opSlt(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] =
+        (int32_t(regData.registers[d.rs]) < int32_t(regData.registers[d.rt])) ? 1 : 0;
+}
+
+void Emulator::opSltu(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = (regData.registers[d.rs] < regData.registers[d.rt]) ? 1 : 0;
+}
+
+void Emulator::opSll(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rt] << d.shamt;
+}
+
+void Emulator::opSrl(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rt] >> d.shamt;
+}
+
+void Emulator::opSub(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rd] = regData.registers[d.rs] - regData.registers[d.rt];
+}
+
+void Emulator::opSubu(const DecodedInstruction& d, InstructionInfo& info) {
+    uint32_t a = regData.registers[d.rs];
+    uint32_t b = regData.registers[d.rt];
+    uint32_t diff = a - b;
+    // signed overflow iff the operands differ in sign and the result takes b's sign
+    bool overflow = ((a ^ b) & (a ^ diff)) >> 31;
+    TRACE_TRACE(TRACE_EMULATOR, "subu " << int32_t(a) << " - " << int32_t(b) << " = "
+                                        << int32_t(diff) << ", " << LOG_VAR(overflow));
+    if (overflow) {
+        info.isOverflow = true;
+        PC = 0x8000;
+    } else {
+        regData.registers[d.rd] = diff;
     }
-    return info;  // return the InstructionInfo struct of the instruction just executed
+}
+
+void Emulator::opIllegalFunct(const DecodedInstruction& d, InstructionInfo& info) {
+    TRACE_ERROR(TRACE_EMULATOR, "Illegal operation...");
+    info.isValid = false;
+}
+
+void Emulator::opAddi(const DecodedInstruction& d, InstructionInfo& info) {
+    uint32_t a = regData.registers[d.rs];
+    uint32_t b = d.signExtImm;
+    uint32_t sum = a + b;
+    bool overflow = ((a ^ sum) & (b ^ sum)) >> 31;
+    TRACE_TRACE(TRACE_EMULATOR, "addi " << int32_t(a) << " + " << int32_t(b) << " = "
+                                        << int32_t(sum) << ", " << LOG_VAR(overflow));
+    if (overflow) {
+        info.isOverflow = true;
+        PC = 0x8000;
+    } else {
+        regData.registers[d.rt] = sum;
+    }
+}
+
+void Emulator::opAddiu(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = regData.registers[d.rs] + d.signExtImm;
+}
+
+void Emulator::opAndi(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = regData.registers[d.rs] & d.zeroExtImm;
+}
+
+void Emulator::opBeq(const DecodedInstruction& d, InstructionInfo& info) {
+    if (regData.registers[d.rs] == regData.registers[d.rt]) {
+        encounteredBranch = true;
+        savedBranch = PC + d.branchAddr;
+    }
+}
+
+void Emulator::opBne(const DecodedInstruction& d, InstructionInfo& info) {
+    if (regData.registers[d.rs] != regData.registers[d.rt]) {
+        encounteredBranch = true;
+        savedBranch = PC + d.branchAddr;
+    }
+}
+
+void Emulator::opBlez(const DecodedInstruction& d, InstructionInfo& info) {
+    if (regData.registers[d.rs] == 0 || (regData.registers[d.rs] & 0x80000000)) {
+        encounteredBranch = true;
+        savedBranch = PC + d.branchAddr;
+    }
+}
+
+void Emulator::opBgtz(const DecodedInstruction& d, InstructionInfo& info) {
+    if (!(regData.registers[d.rs] & 0x80000000) && regData.registers[d.rs] != 0) {
+        encounteredBranch = true;
+        savedBranch = PC + d.branchAddr;
+    }
+}
+
+void Emulator::opJ(const DecodedInstruction& d, InstructionInfo& info) {
+    encounteredBranch = true;
+    savedBranch = info.jumpAddr;
+}
+
+void Emulator::opJal(const DecodedInstruction& d, InstructionInfo& info) {
+    encounteredBranch = true;
+    regData.registers[31] = PC + 4;
+    savedBranch = info.jumpAddr;
+}
+
+void Emulator::opLbu(const DecodedInstruction& d, InstructionInfo& info) {
+    info.loadAddress = regData.registers[d.rs] + d.signExtImm;  // capture load address
+    memory->read8(info.loadAddress, regData.registers[d.rt]);
+}
+
+void Emulator::opLhu(const DecodedInstruction& d, InstructionInfo& info) {
+    info.loadAddress = regData.registers[d.rs] + d.signExtImm;  // capture load address
+    memory->read16(info.loadAddress, regData.registers[d.rt]);
+}
+
+void Emulator::opLui(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = d.zeroExtImm << 16;
+}
+
+void Emulator::opLw(const DecodedInstruction& d, InstructionInfo& info) {
+    info.loadAddress = regData.registers[d.rs] + d.signExtImm;  // capture load address
+    memory->read32(info.loadAddress, regData.registers[d.rt]);
+}
+
+void Emulator::opOri(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = regData.registers[d.rs] | d.zeroExtImm;
+}
+
+void Emulator::opSlti(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = (int32_t(regData.registers[d.rs]) < int32_t(d.signExtImm)) ? 1 : 0;
+}
+
+void Emulator::opSltiu(const DecodedInstruction& d, InstructionInfo& info) {
+    regData.registers[d.rt] = (regData.registers[d.rs] < uint32_t(d.signExtImm)) ? 1 : 0;
+}
+
+void Emulator::opSb(const DecodedInstruction& d, InstructionInfo& info) {
+    info.storeAddress = regData.registers[d.rs] + d.signExtImm;  // capture store address
+    memory->write8(info.storeAddress, regData.registers[d.rt]);
+    invalidateDecoded(info.storeAddress, BYTE_SIZE);
+}
+
+void Emulator::opSh(const DecodedInstruction& d, InstructionInfo& info) {
+    info.storeAddress = regData.registers[d.rs] + d.signExtImm;  // capture store address
+    memory->write16(info.storeAddress, regData.registers[d.rt]);
+    invalidateDecoded(info.storeAddress, HALF_SIZE);
+}
+
+void Emulator::opSw(const DecodedInstruction& d, InstructionInfo& info) {
+    info.storeAddress = regData.registers[d.rs] + d.signExtImm;  // capture store address
+    memory->write32(info.storeAddress, regData.registers[d.rt]);
+    invalidateDecoded(info.storeAddress, WORD_SIZE);
+}
+
+void Emulator::opIllegal(const DecodedInstruction& d, InstructionInfo& info) {
+    TRACE_ERROR(TRACE_EMULATOR, "Illegal operation...");
+    PC = 0x8000;
+    info.isValid = false;
 }
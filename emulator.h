@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "MemoryStore.h"
 #include "RegisterInfo.h"
@@ -52,6 +54,13 @@ enum FUNCT_IDS {
     FUN_SUBU = 0x23    // substract unsigned (subu)
 };
 
+// Engines that can drive a functional run
+enum ExecutionEngine {
+    ENGINE_INTERPRETER,  // executeInstruction() one instruction at a time
+    ENGINE_THREADED,     // runThreaded() over cached basic blocks
+    ENGINE_JIT           // runJit(), blocks translated to native x86-64 code
+};
+
 class Emulator {
    private:
     union REGS {
@@ -106,14 +115,196 @@ class Emulator {
 
     // getters and setters
     auto getPC() { return PC; }
-    auto getDin() { return din; }
+    // where execution starts, set before running
+    void setPC(uint32_t pc) { PC = pc; }
+    auto getDin() const { return din; }
     auto getMemory() { return memory; }
 
-    void setMemory(MemoryStore* mem) { memory = mem; }
+    void setMemory(MemoryStore* mem) {
+        memory = mem;
+        flushDecodeCache();
+    }
+
+    // Registers, PC, branch delay state and din, with memory as it was. Memory pages are
+    // shared copy-on-write between the snapshot, the emulator and everything restored
+    // from it, so taking one costs a page directory and each restore only the pages it
+    // goes on to write.
+    struct Snapshot {
+        uint32_t registers[32];
+        uint32_t PC;
+        bool encounteredBranch;
+        uint32_t savedBranch;
+        uint32_t din;
+        std::shared_ptr<const MemoryStore> memory;
+    };
+    Snapshot snapshot() const;
+    // replaces the emulator's memory with a copy of the snapshot's
+    void restore(const Snapshot& snapshot);
+
+    // the same state, memory included, in a checkpoint file (see Checkpoint.h)
+    void save(CheckpointWriter& out) const;
+    Status load(CheckpointReader& in);
 
     // functionally execute one instruction
     InstructionInfo executeInstruction();
 
+    // Execute up to maxInstructions (0 = no limit) with the threaded-code engine, stopping
+    // early on 0xfeedfeed. Returns the number of instructions executed. Architectural state
+    // matches what the same number of executeInstruction() calls would leave behind.
+    uint32_t runThreaded(uint32_t maxInstructions, bool& halted);
+
+    // Same contract as runThreaded(), but hot blocks are translated to x86-64 and run
+    // natively. Falls back to runThreaded() on other hosts or if no executable memory
+    // can be mapped.
+    uint32_t runJit(uint32_t maxInstructions, bool& halted);
+
     // Helper function to dump registers and memory
     void dumpRegMem(const std::string& output_name);
+
+   private:
+    struct DecodedInstruction;
+    typedef void (Emulator::*Handler)(const DecodedInstruction&, InstructionInfo&);
+
+    // What a decoded instruction does; indexes both the handler table and the
+    // threaded engine's label table.
+    enum OpKind {
+        K_ADD, K_ADDU, K_AND, K_JR, K_NOR, K_OR, K_SLT, K_SLTU, K_SLL, K_SRL, K_SUB, K_SUBU,
+        K_ILLEGAL_FUNCT,
+        K_ADDI, K_ADDIU, K_ANDI, K_BEQ, K_BNE, K_BLEZ, K_BGTZ, K_J, K_JAL, K_LBU, K_LHU,
+        K_LUI, K_LW, K_ORI, K_SLTI, K_SLTIU, K_SB, K_SH, K_SW, K_ILLEGAL,
+        K_HALT,
+        NUM_OP_KINDS
+    };
+    static const Handler handlers[NUM_OP_KINDS];
+
+    // branches and jumps, the instructions that come with a delay slot
+    static bool isControlTransfer(OpKind kind) {
+        return kind == K_JR || kind == K_J || kind == K_JAL || kind == K_BEQ || kind == K_BNE ||
+               kind == K_BLEZ || kind == K_BGTZ;
+    }
+
+    // An instruction that has already been fetched and decoded, cached by PC so that
+    // loops only pay for the fetch and decode the first time through.
+    struct DecodedInstruction {
+        uint32_t pc = 0;
+        bool     valid = false;
+        uint32_t instruction = 0;
+        uint32_t opcode = 0;
+        uint32_t rs = 0;
+        uint32_t rt = 0;
+        uint32_t rd = 0;
+        uint32_t shamt = 0;
+        uint32_t funct = 0;
+        uint16_t immediate = 0;
+        uint32_t address = 0;
+        int32_t  signExtImm = 0;
+        uint32_t zeroExtImm = 0;
+        uint32_t branchAddr = 0;
+        OpKind   kind = K_ILLEGAL;
+        Handler  handler = nullptr;
+        bool     inBlock = false;  // referenced by a threaded block
+    };
+
+    // direct-mapped on the word address, large enough to cover all of MEMORY_SIZE
+    static const uint32_t DECODE_CACHE_ENTRIES = MEMORY_SIZE / WORD_SIZE;
+    std::vector<DecodedInstruction> decodeCache;
+
+    // fetch and decode the instruction at pc, going through the decode cache
+    const DecodedInstruction& fetchDecoded(uint32_t pc, DecodedInstruction& scratch);
+    void decode(uint32_t instruction, DecodedInstruction& decoded);
+    // drop cached decodes overlapping a store to [address, address + size)
+    void invalidateDecoded(uint32_t address, uint32_t size);
+    void flushDecodeCache();
+
+    // One step of a threaded block: the label to jump to and the instruction it runs.
+    struct ThreadedOp {
+        const void* target;
+        OpKind kind;
+        const DecodedInstruction* d;
+    };
+
+    // A straight-line run of instructions ending after a control transfer and its
+    // delay slot, a halt, an illegal instruction or MAX_BLOCK_OPS.
+    struct ThreadedBlock {
+        uint32_t pc = 0;
+        bool valid = false;
+        bool resolved = false;  // targets filled in from the label table
+        std::vector<ThreadedOp> ops;
+    };
+
+    static const uint32_t BLOCK_CACHE_ENTRIES = 1024;
+    static const uint32_t MAX_BLOCK_OPS = 32;
+    std::vector<ThreadedBlock> blockCache;
+    bool codeModified;  // a store or decode eviction hit an instruction held by a block
+
+    ThreadedBlock& lookupBlock(uint32_t pc);
+    void flushBlocks();
+
+    // A block as seen by the translator. Cold blocks are interpreted and only counted;
+    // once a block reaches JIT_HOT_THRESHOLD entries it is translated.
+    struct JitEntry {
+        uint32_t pc = 0;
+        bool valid = false;
+        uint32_t length = 0;  // instructions in the block, 0 if it can't be translated
+        uint32_t visits = 0;
+        const uint8_t* code = nullptr;
+    };
+
+    // Shared between translated code and the helpers it calls; filled in on block exit
+    struct JitContext {
+        uint32_t pc;        // where execution continues
+        uint32_t executed;  // instructions retired by the block
+        Emulator* emulator;
+    };
+
+    static const uint32_t JIT_CACHE_ENTRIES = 4096;
+    static const uint32_t JIT_MAX_BLOCK_OPS = 64;
+    static const uint32_t JIT_HOT_THRESHOLD = 4;
+    static const size_t JIT_CODE_SIZE = 4 << 20;
+    std::vector<JitEntry> jitCache;
+    uint8_t* jitCode;  // executable code cache, mapped on first use
+    size_t jitCodeUsed;
+
+    uint32_t scanJitBlock(uint32_t pc, std::vector<const DecodedInstruction*>& ops);
+    JitEntry& lookupJit(uint32_t pc);
+    const uint8_t* translateBlock(uint32_t pc);
+    void flushJit();
+    void releaseJit();
+    static uint32_t jitLoad(JitContext* ctx, uint32_t address, uint32_t rt, uint32_t size);
+    static uint32_t jitStore(JitContext* ctx, uint32_t address, uint32_t value, uint32_t size);
+
+    // per-instruction handlers, selected once at decode time
+    void opAdd(const DecodedInstruction& d, InstructionInfo& info);
+    void opAddu(const DecodedInstruction& d, InstructionInfo& info);
+    void opAnd(const DecodedInstruction& d, InstructionInfo& info);
+    void opJr(const DecodedInstruction& d, InstructionInfo& info);
+    void opNor(const DecodedInstruction& d, InstructionInfo& info);
+    void opOr(const DecodedInstruction& d, InstructionInfo& info);
+    void opSlt(const DecodedInstruction& d, InstructionInfo& info);
+    void opSltu(const DecodedInstruction& d, InstructionInfo& info);
+    void opSll(const DecodedInstruction& d, InstructionInfo& info);
+    void opSrl(const DecodedInstruction& d, InstructionInfo& info);
+    void opSub(const DecodedInstruction& d, InstructionInfo& info);
+    void opSubu(const DecodedInstruction& d, InstructionInfo& info);
+    void opIllegalFunct(const DecodedInstruction& d, InstructionInfo& info);
+    void opAddi(const DecodedInstruction& d, InstructionInfo& info);
+    void opAddiu(const DecodedInstruction& d, InstructionInfo& info);
+    void opAndi(const DecodedInstruction& d, InstructionInfo& info);
+    void opBeq(const DecodedInstruction& d, InstructionInfo& info);
+    void opBne(const DecodedInstruction& d, InstructionInfo& info);
+    void opBlez(const DecodedInstruction& d, InstructionInfo& info);
+    void opBgtz(const DecodedInstruction& d, InstructionInfo& info);
+    void opJ(const DecodedInstruction& d, InstructionInfo& info);
+    void opJal(const DecodedInstruction& d, InstructionInfo& info);
+    void opLbu(const DecodedInstruction& d, InstructionInfo& info);
+    void opLhu(const DecodedInstruction& d, InstructionInfo& info);
+    void opLui(const DecodedInstruction& d, InstructionInfo& info);
+    void opLw(const DecodedInstruction& d, InstructionInfo& info);
+    void opOri(const DecodedInstruction& d, InstructionInfo& info);
+    void opSlti(const DecodedInstruction& d, InstructionInfo& info);
+    void opSltiu(const DecodedInstruction& d, InstructionInfo& info);
+    void opSb(const DecodedInstruction& d, InstructionInfo& info);
+    void opSh(const DecodedInstruction& d, InstructionInfo& info);
+    void opSw(const DecodedInstruction& d, InstructionInfo& info);
+    void opIllegal(const DecodedInstruction& d, InstructionInfo& info);
 };
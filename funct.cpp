@@ -1,33 +1,105 @@
 #include "funct.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "cache.h"
 #include "Utilities.h"
 #include "emulator.h"
 
-static Emulator* emulator = nullptr;
-static std::string output;
+// the simulator behind the free functions in funct.h
+static std::unique_ptr<FunctionalSimulator> simulator;
+static ExecutionEngine defaultEngine = ENGINE_INTERPRETER;
+static bool defaultAccessTrace = false;
+
+void setExecutionEngine(ExecutionEngine e) { defaultEngine = e; }
+
+void setAccessTrace(bool enabled) { defaultAccessTrace = enabled; }
+
+Status initEmulator(MemoryStore* mem, const std::string& output_name, uint32_t entry) {
+    simulator.reset(new FunctionalSimulator());
+    simulator->setExecutionEngine(defaultEngine);
+    simulator->setAccessTrace(defaultAccessTrace);
+    simulator->setCheckpointInterval(getCheckpointInterval());
+    return simulator->init(mem, output_name, entry);
+}
+
+Status restoreEmulator(const std::string& checkpoint) {
+    return simulator->loadCheckpoint(checkpoint);
+}
+
+Status runInstructions(uint32_t instructions) { return simulator->runInstructions(instructions); }
+
+Status runTillHalt() { return simulator->runTillHalt(); }
+
+Status finalizeEmulator() { return simulator->finalize(); }
+
+FunctionalSimulator::FunctionalSimulator()
+    : engine(ENGINE_INTERPRETER), accessTrace(false), checkpointInterval(0), nextCheckpoint(0) {}
 
 // initialize the emulator
-Status initEmulator(MemoryStore* mem, const std::string& output_name) {
+Status FunctionalSimulator::init(MemoryStore* mem, const std::string& output_name,
+                                 uint32_t entry) {
     output = output_name;
-    emulator = new Emulator();
+    emulator.reset(new Emulator());
     emulator->setMemory(mem);
+    emulator->setPC(entry);
+    if (checkpointInterval > 0) nextCheckpoint = checkpointInterval;
+    if (accessTrace) {
+        if (engine != ENGINE_INTERPRETER) {
+            TRACE_INFO(TRACE_SIM, "Recording an access trace, running the interpreter");
+        }
+        return traceWriter.open(output_name);
+    }
     return SUCCESS;
 }
 
 // run the emulator for a certain number of intructions
 // return SUCCESS if count of executed instructions == desired intructions.
 // return HALT if the simulator halts on 0xfeedfeed
-Status runInstructions(uint32_t instructions) {
+Status FunctionalSimulator::runInstructions(uint32_t instructions) {
+    uint32_t executed;
+    if (checkpointInterval == 0) return run(instructions, executed);
+
+    // in steps that end where the checkpoints go; one that is due is written first, so
+    // a step is never 0, which would mean no limit
+    uint32_t done = 0;
+    while (true) {
+        uint32_t din = emulator->getDin();
+        if (din >= nextCheckpoint) {
+            if (saveCheckpoint(checkpointFileName(output, din)) != SUCCESS) return ERROR;
+            nextCheckpoint = nextCheckpointDin(din, checkpointInterval);
+        }
+        if (instructions != 0 && done >= instructions) return SUCCESS;
+
+        uint32_t step = nextCheckpoint - din;
+        if (instructions != 0) step = std::min(step, instructions - done);
+        Status status = run(step, executed);
+        done += executed;
+        if (status != SUCCESS) return status;
+    }
+}
+
+Status FunctionalSimulator::run(uint32_t instructions, uint32_t& executed) {
     uint32_t numInstructions = 0;
     auto status = SUCCESS;
+    executed = 0;
+
+    if (!accessTrace && (engine == ENGINE_THREADED || engine == ENGINE_JIT)) {
+        bool halted;
+        if (engine == ENGINE_JIT)
+            executed = emulator->runJit(instructions, halted);
+        else
+            executed = emulator->runThreaded(instructions, halted);
+        return halted ? HALT : SUCCESS;
+    }
 
     while (instructions == 0 || numInstructions < instructions) {
         Emulator::InstructionInfo info = emulator->executeInstruction();
 
         numInstructions += 1;
+        executed = numInstructions;
+        if (accessTrace && traceWriter.write(info) != SUCCESS) return ERROR;
 
         if (info.isHalt) {
             status = HALT;
@@ -37,21 +109,41 @@ Status runInstructions(uint32_t instructions) {
     return status;
 }
 
-// run till halt (call runInstructions() with instructions == 1 each time) until
-// status tells you to HALT or ERROR out
-Status runTillHalt() {
+// run till halt (call runInstructions() with no instruction limit, so the threaded
+// engine gets whole blocks) until status tells you to HALT or ERROR out
+Status FunctionalSimulator::runTillHalt() {
     Status status;
     while (true) {
-        status = static_cast<Status>(runInstructions(1));
-        if (status == HALT) break;
+        status = static_cast<Status>(runInstructions(0));
+        if (status == HALT || status == ERROR) break;
     }
     return status;
 }
 
+Status FunctionalSimulator::saveCheckpoint(const std::string& fileName) const {
+    CheckpointWriter out;
+    if (out.open(fileName, CHECKPOINT_FUNCTIONAL) != SUCCESS) return ERROR;
+    emulator->save(out);
+    return out.close();
+}
+
+Status FunctionalSimulator::loadCheckpoint(const std::string& fileName) {
+    CheckpointReader in;
+    if (in.open(fileName) != SUCCESS || emulator->load(in) != SUCCESS) return ERROR;
+    if (in.getKind() == CHECKPOINT_CYCLE) {
+        TRACE_INFO(TRACE_SIM, "Continuing a cycle checkpoint functionally, without its caches "
+                              "and pipeline");
+    }
+    if (checkpointInterval > 0) {
+        nextCheckpoint = nextCheckpointDin(emulator->getDin(), checkpointInterval);
+    }
+    return SUCCESS;
+}
+
 // dump the stats of the emulator
-Status finalizeEmulator() {
+Status FunctionalSimulator::finalize() {
     emulator->dumpRegMem(output);
     SimulationStats stats{emulator->getDin(), 0,};
     dumpSimStats(stats, output);
-    return SUCCESS;
+    return traceWriter.close();
 }
@@ -1,16 +1,71 @@
 #pragma once
+#include <memory>
 #include <string>
 
+#include "AccessTrace.h"
+#include "Checkpoint.h"
 #include "Utilities.h"
 #include "emulator.h"
 
+// One functional simulation. Independent instances can run side by side, on different
+// threads too.
+class FunctionalSimulator {
+   public:
+    FunctionalSimulator();
+    FunctionalSimulator(const FunctionalSimulator&) = delete;
+    FunctionalSimulator& operator=(const FunctionalSimulator&) = delete;
+
+    // defaults to ENGINE_INTERPRETER
+    void setExecutionEngine(ExecutionEngine e) { engine = e; }
+    // record every fetch, load and store to <output_name>_access_trace.bin; the
+    // threaded and JIT engines do not report single instructions, so this runs the
+    // interpreter. Set before init().
+    void setAccessTrace(bool enabled) { accessTrace = enabled; }
+    // write a checkpoint every time din reaches a multiple of instructions, 0 for never
+    void setCheckpointInterval(uint32_t instructions) { checkpointInterval = instructions; }
+
+    // takes ownership of memory, the emulator deletes it; execution starts at entry
+    Status init(MemoryStore* memory, const std::string& output_name, uint32_t entry = 0);
+    Status runInstructions(uint32_t instructions);
+    Status runTillHalt();
+    Status finalize();
+
+    // after init(); a cycle checkpoint goes on functionally, its caches and pipeline
+    // left out
+    Status saveCheckpoint(const std::string& fileName) const;
+    Status loadCheckpoint(const std::string& fileName);
+
+   private:
+    // runInstructions() without checkpoints
+    Status run(uint32_t instructions, uint32_t& executed);
+
+    std::unique_ptr<Emulator> emulator;
+    std::string output;
+    ExecutionEngine engine;
+    bool accessTrace;
+    AccessTraceWriter traceWriter;
+    uint32_t checkpointInterval;
+    uint32_t nextCheckpoint;  // din of the next one
+};
+
+// The free functions below drive one process-wide FunctionalSimulator.
+
 // init the emulator and all info
-Status initEmulator(MemoryStore* memory, const std::string& output_name);
+Status initEmulator(MemoryStore* memory, const std::string& output_name, uint32_t entry = 0);
+
+// pick the engine runInstructions() uses, defaults to ENGINE_INTERPRETER
+void setExecutionEngine(ExecutionEngine engine);
+
+// record an access trace from the next initEmulator() on, off by default
+void setAccessTrace(bool enabled);
+
+// continue from a checkpoint file, after initEmulator()
+Status restoreEmulator(const std::string& checkpoint);
 
 // run the emulator for a certain number of instructions
 Status runInstructions(uint32_t instructions);
 
-// run till halt (call runInstructions() with instructions == 1 each time) until
+// run till halt (call runInstructions() with no instruction limit) until
 // status tells you to HALT or ERROR out
 Status runTillHalt();
 
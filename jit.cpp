@@ -0,0 +1,512 @@
+/**
+ * jit.cpp
+ * Basic-block translator from MIPS to x86-64 for Emulator.
+ *
+ * Blocks are found the same way the threaded engine finds them, but once a block
+ * has been entered JIT_HOT_THRESHOLD times it is compiled into the executable code
+ * cache and from then on runs natively. Translated code keeps the guest registers
+ * in Emulator::regData (addressed through rbx) and calls back into the emulator for
+ * loads and stores, so memory faults and self-modifying code behave exactly as in
+ * the interpreter. A block exits back to the dispatcher when it runs off its end
+ * (after a branch/jump and its delay slot), on an overflow trap, on 0xfeedfeed and
+ * after a store that overwrote code.
+ *
+ * Differences from the interpreter: the TRACE_LEVEL_TRACE output of add, addi and
+ * subu is not reproduced by translated code.
+ */
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "emulator.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+using namespace std;
+
+// how a translated block handed control back
+enum JitExit { JIT_EXIT_END = 0, JIT_EXIT_HALT = 1, JIT_EXIT_TRAP = 2, JIT_EXIT_MODIFIED = 3 };
+
+// Collect the instructions of the block starting at pc into ops. A block ends after a
+// control transfer and its delay slot, on a halt, or before anything the translator
+// leaves to the interpreter (faulting fetches, illegal instructions, and control
+// transfers whose delay slot can't be part of the block).
+uint32_t Emulator::scanJitBlock(uint32_t pc, std::vector<const DecodedInstruction*>& ops) {
+    ops.clear();
+    DecodedInstruction scratch;
+    bool delaySlot = false;
+
+    for (uint32_t p = pc; ops.size() < JIT_MAX_BLOCK_OPS; p += 4) {
+        const DecodedInstruction& d = fetchDecoded(p, scratch);
+        bool stop = (&d == &scratch || d.kind == K_ILLEGAL || d.kind == K_ILLEGAL_FUNCT);
+        bool transfer = !stop && isControlTransfer(d.kind);
+
+        if (delaySlot) {
+            // branch in a delay slot: give both back to the interpreter
+            if (stop || transfer) ops.pop_back();
+            else ops.push_back(&d);
+            delaySlot = false;
+            break;
+        }
+        if (stop) break;
+
+        ops.push_back(&d);
+        if (d.kind == K_HALT) break;
+        delaySlot = transfer;
+    }
+    // ran out of room (or instructions) before the delay slot
+    if (delaySlot) ops.pop_back();
+
+    return ops.size();
+}
+
+Emulator::JitEntry& Emulator::lookupJit(uint32_t pc) {
+    JitEntry& entry = jitCache[(pc >> 2) % JIT_CACHE_ENTRIES];
+    if (entry.valid && entry.pc == pc) return entry;
+
+    std::vector<const DecodedInstruction*> ops;
+    entry.pc = pc;
+    entry.valid = true;
+    entry.visits = 0;
+    entry.code = nullptr;
+    entry.length = scanJitBlock(pc, ops);
+    return entry;
+}
+
+void Emulator::flushJit() {
+    for (auto& entry : jitCache) entry.valid = false;
+    jitCodeUsed = 0;
+}
+
+void Emulator::releaseJit() {
+#if JIT_SUPPORTED
+    if (jitCode) munmap(jitCode, JIT_CODE_SIZE);
+#endif
+    jitCode = nullptr;
+    jitCodeUsed = 0;
+}
+
+// Helpers called from translated code. They go through MemoryStore exactly like the
+// interpreter's handlers do.
+uint32_t Emulator::jitLoad(JitContext* ctx, uint32_t address, uint32_t rt, uint32_t size) {
+    Emulator* emu = ctx->emulator;
+    uint32_t value;
+    emu->memory->read(address, value, size);
+    if (rt != 0) emu->regData.registers[rt] = value;
+    return 0;
+}
+
+// returns nonzero if the store hit an instruction that is part of a block
+uint32_t Emulator::jitStore(JitContext* ctx, uint32_t address, uint32_t value, uint32_t size) {
+    Emulator* emu = ctx->emulator;
+    emu->memory->write(address, value, size);
+    emu->invalidateDecoded(address, size);
+    return emu->codeModified;
+}
+
+#if JIT_SUPPORTED
+
+namespace {
+
+// x86 condition codes
+enum Cond { CC_O = 0x0, CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_LE = 0xe, CC_G = 0xf };
+
+// ALU opcodes in their "op eax, r/m32" and "op eax, imm32" forms
+enum AluOp {
+    ALU_ADD = 0x03, ALU_OR = 0x0b, ALU_AND = 0x23, ALU_SUB = 0x2b, ALU_CMP = 0x3b,
+};
+
+// Just enough of an x86-64 assembler for the translator. Guest registers live at
+// [rbx + 4 * r], the JitContext is in r12 and r13d holds the pending branch target.
+struct X64Emitter {
+    uint8_t* p;
+
+    void byte(uint8_t b) { *p++ = b; }
+    void imm32(uint32_t v) {
+        memcpy(p, &v, 4);
+        p += 4;
+    }
+    void imm64(uint64_t v) {
+        memcpy(p, &v, 8);
+        p += 8;
+    }
+
+    // push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi
+    void prologue() {
+        byte(0x53);
+        byte(0x41), byte(0x54);
+        byte(0x41), byte(0x55);
+        byte(0x48), byte(0x89), byte(0xfb);
+        byte(0x49), byte(0x89), byte(0xf4);
+    }
+    // pop r13; pop r12; pop rbx; ret
+    void epilogue() {
+        byte(0x41), byte(0x5d);
+        byte(0x41), byte(0x5c);
+        byte(0x5b);
+        byte(0xc3);
+    }
+
+    // mov eax, [reg]
+    void loadEax(uint32_t r) { byte(0x8b), byte(0x43), byte(r * 4); }
+    // mov edx, [reg]
+    void loadEdx(uint32_t r) { byte(0x8b), byte(0x53), byte(r * 4); }
+    // mov [reg], eax
+    void storeEax(uint32_t r) { byte(0x89), byte(0x43), byte(r * 4); }
+    // mov dword [reg], imm32
+    void storeImm(uint32_t r, uint32_t v) {
+        byte(0xc7), byte(0x43), byte(r * 4);
+        imm32(v);
+    }
+    // op eax, [reg]
+    void aluReg(AluOp op, uint32_t r) { byte(op), byte(0x43), byte(r * 4); }
+    // op eax, imm32 (the short eax forms are the r/m opcode + 2)
+    void aluImm(AluOp op, uint32_t v) {
+        byte(op + 2);
+        imm32(v);
+    }
+    // cmp dword [reg], 0
+    void cmpRegZero(uint32_t r) { byte(0x83), byte(0x7b), byte(r * 4), byte(0); }
+    // not eax
+    void notEax() { byte(0xf7), byte(0xd0); }
+    // shl/shr eax, n
+    void shlEax(uint8_t n) { byte(0xc1), byte(0xe0), byte(n); }
+    void shrEax(uint8_t n) { byte(0xc1), byte(0xe8), byte(n); }
+    // setcc al; movzx eax, al
+    void setccEax(Cond cc) {
+        byte(0x0f), byte(0x90 | cc), byte(0xc0);
+        byte(0x0f), byte(0xb6), byte(0xc0);
+    }
+    // and edx, imm32
+    void andEdx(uint32_t v) {
+        byte(0x81), byte(0xe2);
+        imm32(v);
+    }
+    // test eax, eax
+    void testEax() { byte(0x85), byte(0xc0); }
+    // mov eax/ecx/edx/r13d, imm32
+    void movEax(uint32_t v) { byte(0xb8), imm32(v); }
+    void movEcx(uint32_t v) { byte(0xb9), imm32(v); }
+    void movEdx(uint32_t v) { byte(0xba), imm32(v); }
+    void movR13(uint32_t v) { byte(0x41), byte(0xbd), imm32(v); }
+    // mov r13d, [reg]
+    void loadR13(uint32_t r) { byte(0x44), byte(0x8b), byte(0x6b), byte(r * 4); }
+    // cmovcc r13d, ecx
+    void cmovR13Ecx(Cond cc) { byte(0x44), byte(0x0f), byte(0x40 | cc), byte(0xe9); }
+    // mov dword [r12 + off], imm32 / mov [r12 + off], r13d
+    void storeCtxImm(uint8_t off, uint32_t v) {
+        byte(0x41), byte(0xc7), byte(0x44), byte(0x24), byte(off);
+        imm32(v);
+    }
+    void storeCtxR13(uint8_t off) { byte(0x45), byte(0x89), byte(0x6c), byte(0x24), byte(off); }
+    // mov esi, eax
+    void movEsiEax() { byte(0x89), byte(0xc6); }
+    // mov rdi, r12; mov rax, fn; call rax
+    void callHelper(const void* fn) {
+        byte(0x4c), byte(0x89), byte(0xe7);
+        byte(0x48), byte(0xb8);
+        imm64(reinterpret_cast<uint64_t>(fn));
+        byte(0xff), byte(0xd0);
+    }
+    // jcc/jmp rel32 with the displacement left to patch(); returns the field
+    uint8_t* jcc(Cond cc) {
+        byte(0x0f), byte(0x80 | cc);
+        imm32(0);
+        return p - 4;
+    }
+    uint8_t* jmp() {
+        byte(0xe9);
+        imm32(0);
+        return p - 4;
+    }
+    static void patch(uint8_t* field, const uint8_t* target) {
+        int32_t rel = static_cast<int32_t>(target - (field + 4));
+        memcpy(field, &rel, 4);
+    }
+};
+
+// an exit taken from the middle of a block, emitted after the epilogue
+struct JitStub {
+    uint8_t* field;    // jcc displacement to patch
+    bool pcFromR13;    // continue at the pending branch target
+    uint32_t pc;       // otherwise continue here
+    uint32_t executed;
+    JitExit status;
+};
+
+// worst case bytes per translated instruction plus its stub
+const size_t JIT_BYTES_PER_OP = 96;
+
+}  // namespace
+
+const uint8_t* Emulator::translateBlock(uint32_t pc) {
+    std::vector<const DecodedInstruction*> ops;
+    uint32_t n = scanJitBlock(pc, ops);
+    if (n == 0) return nullptr;
+
+    size_t worstCase = 64 + n * JIT_BYTES_PER_OP;
+    if (jitCodeUsed + worstCase > JIT_CODE_SIZE) {
+        flushJit();
+        // the caller's entry went with the flush, put it back
+        JitEntry& entry = jitCache[(pc >> 2) % JIT_CACHE_ENTRIES];
+        entry.pc = pc;
+        entry.valid = true;
+        entry.visits = 0;
+        entry.length = n;
+    }
+
+    const uint8_t* start = jitCode + jitCodeUsed;
+    X64Emitter e{jitCode + jitCodeUsed};
+    std::vector<JitStub> stubs;
+    std::vector<uint8_t*> toEpilogue;
+
+    e.prologue();
+    e.storeImm(0, 0);  // $zero
+
+    for (uint32_t i = 0; i < n; i++) {
+        const DecodedInstruction& d = *ops[i];
+        uint32_t at = pc + 4 * i;
+        bool inDelaySlot = i >= 1 && isControlTransfer(ops[i - 1]->kind);
+        uint32_t fallthrough = at + 8;
+        uint32_t taken = at + 4 + d.branchAddr;
+
+        decodeCache[(at >> 2) % DECODE_CACHE_ENTRIES].inBlock = true;
+
+        switch (d.kind) {
+            case K_ADD:
+            case K_SUBU:
+                e.loadEax(d.rs);
+                e.aluReg(d.kind == K_ADD ? ALU_ADD : ALU_SUB, d.rt);
+                stubs.push_back({e.jcc(CC_O), false, 0x8000, i + 1, JIT_EXIT_TRAP});
+                if (d.rd) e.storeEax(d.rd);
+                break;
+            case K_ADDI:
+                e.loadEax(d.rs);
+                e.aluImm(ALU_ADD, d.signExtImm);
+                stubs.push_back({e.jcc(CC_O), false, 0x8000, i + 1, JIT_EXIT_TRAP});
+                if (d.rt) e.storeEax(d.rt);
+                break;
+            case K_ADDU:
+            case K_AND:
+            case K_OR:
+            case K_NOR:
+            case K_SUB:
+                if (!d.rd) break;
+                e.loadEax(d.rs);
+                e.aluReg(d.kind == K_ADDU  ? ALU_ADD
+                         : d.kind == K_AND ? ALU_AND
+                         : d.kind == K_SUB ? ALU_SUB
+                                           : ALU_OR,
+                         d.rt);
+                if (d.kind == K_NOR) e.notEax();
+                e.storeEax(d.rd);
+                break;
+            case K_SLT:
+            case K_SLTU:
+                if (!d.rd) break;
+                e.loadEax(d.rs);
+                e.aluReg(ALU_CMP, d.rt);
+                e.setccEax(d.kind == K_SLT ? CC_L : CC_B);
+                e.storeEax(d.rd);
+                break;
+            case K_SLL:
+            case K_SRL:
+                if (!d.rd) break;
+                e.loadEax(d.rt);
+                if (d.kind == K_SLL) e.shlEax(d.shamt);
+                else e.shrEax(d.shamt);
+                e.storeEax(d.rd);
+                break;
+            case K_ADDIU:
+            case K_ANDI:
+            case K_ORI:
+                if (!d.rt) break;
+                e.loadEax(d.rs);
+                if (d.kind == K_ADDIU) e.aluImm(ALU_ADD, d.signExtImm);
+                else if (d.kind == K_ANDI) e.aluImm(ALU_AND, d.zeroExtImm);
+                else e.aluImm(ALU_OR, d.zeroExtImm);
+                e.storeEax(d.rt);
+                break;
+            case K_SLTI:
+            case K_SLTIU:
+                if (!d.rt) break;
+                e.loadEax(d.rs);
+                e.aluImm(ALU_CMP, d.signExtImm);
+                e.setccEax(d.kind == K_SLTI ? CC_L : CC_B);
+                e.storeEax(d.rt);
+                break;
+            case K_LUI:
+                if (d.rt) e.storeImm(d.rt, d.zeroExtImm << 16);
+                break;
+            case K_BEQ:
+            case K_BNE:
+                e.movR13(fallthrough);
+                e.movEcx(taken);
+                e.loadEax(d.rs);
+                e.aluReg(ALU_CMP, d.rt);
+                e.cmovR13Ecx(d.kind == K_BEQ ? CC_E : CC_NE);
+                break;
+            case K_BLEZ:
+            case K_BGTZ:
+                e.movR13(fallthrough);
+                e.movEcx(taken);
+                e.cmpRegZero(d.rs);
+                e.cmovR13Ecx(d.kind == K_BLEZ ? CC_LE : CC_G);
+                break;
+            case K_J:
+                e.movR13(((at + 4) & 0xf0000000) ^ (d.address << 2));
+                break;
+            case K_JAL:
+                e.storeImm(31, at + 8);
+                e.movR13(((at + 4) & 0xf0000000) ^ (d.address << 2));
+                break;
+            case K_JR:
+                e.loadR13(d.rs);
+                break;
+            case K_LBU:
+            case K_LHU:
+            case K_LW:
+                e.loadEax(d.rs);
+                e.aluImm(ALU_ADD, d.signExtImm);
+                e.movEsiEax();
+                e.movEdx(d.rt);
+                e.movEcx(d.kind == K_LBU ? BYTE_SIZE : d.kind == K_LHU ? HALF_SIZE : WORD_SIZE);
+                e.callHelper(reinterpret_cast<const void*>(&Emulator::jitLoad));
+                break;
+            case K_SB:
+            case K_SH:
+            case K_SW:
+                e.loadEax(d.rs);
+                e.aluImm(ALU_ADD, d.signExtImm);
+                e.movEsiEax();
+                e.loadEdx(d.rt);
+                if (d.kind == K_SB) e.andEdx(0xff);
+                if (d.kind == K_SH) e.andEdx(0xffff);
+                e.movEcx(d.kind == K_SB ? BYTE_SIZE : d.kind == K_SH ? HALF_SIZE : WORD_SIZE);
+                e.callHelper(reinterpret_cast<const void*>(&Emulator::jitStore));
+                e.testEax();
+                stubs.push_back({e.jcc(CC_NE), inDelaySlot, at + 4, i + 1, JIT_EXIT_MODIFIED});
+                break;
+            case K_HALT:
+                if (inDelaySlot) e.storeCtxR13(offsetof(JitContext, pc));
+                else e.storeCtxImm(offsetof(JitContext, pc), at + 4);
+                e.storeCtxImm(offsetof(JitContext, executed), i + 1);
+                e.movEax(JIT_EXIT_HALT);
+                toEpilogue.push_back(e.jmp());
+                break;
+            default:
+                assert(false);  // scanJitBlock never hands us anything else
+        }
+    }
+
+    // fell off the end: after a delay slot the branch target is in r13d
+    if (ops[n - 1]->kind != K_HALT) {
+        if (n >= 2 && isControlTransfer(ops[n - 2]->kind)) e.storeCtxR13(offsetof(JitContext, pc));
+        else e.storeCtxImm(offsetof(JitContext, pc), pc + 4 * n);
+        e.storeCtxImm(offsetof(JitContext, executed), n);
+        e.movEax(JIT_EXIT_END);
+    }
+
+    const uint8_t* epilogue = e.p;
+    e.epilogue();
+    for (auto field : toEpilogue) X64Emitter::patch(field, epilogue);
+
+    for (auto& stub : stubs) {
+        X64Emitter::patch(stub.field, e.p);
+        if (stub.pcFromR13) e.storeCtxR13(offsetof(JitContext, pc));
+        else e.storeCtxImm(offsetof(JitContext, pc), stub.pc);
+        e.storeCtxImm(offsetof(JitContext, executed), stub.executed);
+        e.movEax(stub.status);
+        X64Emitter::patch(e.jmp(), epilogue);
+    }
+
+    assert(static_cast<size_t>(e.p - start) <= worstCase);
+    jitCodeUsed = e.p - jitCode;
+    return start;
+}
+
+uint32_t Emulator::runJit(uint32_t maxInstructions, bool& halted) {
+    assert(memory);
+    if (!jitCode) {
+        void* mem = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            TRACE_ERROR(TRACE_EMULATOR, "Could not map JIT code cache, using the threaded engine");
+            return runThreaded(maxInstructions, halted);
+        }
+        jitCode = static_cast<uint8_t*>(mem);
+        jitCodeUsed = 0;
+        jitCache.assign(JIT_CACHE_ENTRIES, JitEntry());
+    }
+
+    typedef uint32_t (*BlockFn)(uint32_t* regs, JitContext* ctx);
+    JitContext ctx{0, 0, this};
+    uint32_t executed = 0;
+    halted = false;
+
+    while (maxInstructions == 0 || executed < maxInstructions) {
+        if (codeModified) flushBlocks();
+
+        if (!encounteredBranch) {
+            JitEntry& entry = lookupJit(PC);
+            bool fits = maxInstructions == 0 || entry.length <= maxInstructions - executed;
+
+            if (entry.length && fits) {
+                if (!entry.code && ++entry.visits >= JIT_HOT_THRESHOLD) {
+                    entry.code = translateBlock(PC);
+                }
+
+                if (entry.code) {
+                    BlockFn fn = reinterpret_cast<BlockFn>(const_cast<uint8_t*>(entry.code));
+                    uint32_t status = fn(regData.registers, &ctx);
+                    PC = ctx.pc;
+                    din += ctx.executed;
+                    executed += ctx.executed;
+                    if (status == JIT_EXIT_HALT) {
+                        halted = true;
+                        break;
+                    }
+                    continue;
+                }
+
+                // still cold: interpret it, keeping block boundaries where they'll be
+                uint32_t length = entry.length;
+                for (uint32_t i = 0; i < length; i++) {
+                    InstructionInfo info = executeInstruction();
+                    executed += 1;
+                    if (info.isHalt) {
+                        halted = true;
+                        break;
+                    }
+                }
+                if (halted) break;
+                continue;
+            }
+        }
+
+        InstructionInfo info = executeInstruction();
+        executed += 1;
+        if (info.isHalt) {
+            halted = true;
+            break;
+        }
+    }
+    return executed;
+}
+
+#else  // !JIT_SUPPORTED
+
+const uint8_t* Emulator::translateBlock(uint32_t pc) { return nullptr; }
+
+uint32_t Emulator::runJit(uint32_t maxInstructions, bool& halted) {
+    return runThreaded(maxInstructions, halted);
+}
+
+#endif
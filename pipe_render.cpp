@@ -0,0 +1,80 @@
+/**
+ * pipe_render
+ * Turns a binary pipe trace (sim_cycle --pipe-trace=binary) back into the text that
+ * _pipe_state.out would have held, optionally only for a window of cycles.
+ *
+ *   pipe_render <base>_pipe_trace.bin [--from=N] [--to=N] [--out=<base>|-]
+ *
+ * By default the text goes to <base>_pipe_state.out next to the trace; --out=- prints
+ * it to stdout instead. --from/--to are inclusive cycle numbers.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "PipeStateWriter.h"
+#include "PipeTrace.h"
+#include "Utilities.h"
+
+using namespace std;
+
+static const char TRACE_SUFFIX[] = "_pipe_trace.bin";
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0]
+                                         << " <trace.bin> [--from=N] [--to=N] [--out=<base>|-]");
+        return ERROR;
+    }
+
+    string traceFile = argv[1];
+    string outBase;
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--from=", 7) == 0) {
+            from = strtoul(argv[i] + 7, nullptr, 0);
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            to = strtoul(argv[i] + 5, nullptr, 0);
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            outBase = argv[i] + 6;
+        } else {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
+            return ERROR;
+        }
+    }
+
+    if (outBase.empty()) {
+        size_t suffixLen = sizeof(TRACE_SUFFIX) - 1;
+        if (traceFile.size() > suffixLen &&
+            traceFile.compare(traceFile.size() - suffixLen, suffixLen, TRACE_SUFFIX) == 0) {
+            outBase = traceFile.substr(0, traceFile.size() - suffixLen);
+        } else {
+            outBase = getBaseFilename(argv[1]);
+        }
+    }
+
+    PipeTraceReader reader;
+    if (reader.open(traceFile) != SUCCESS) return ERROR;
+
+    bool toStdout = outBase == "-";
+    PipeStateWriter writer;
+    if (!toStdout && writer.open(outBase) != SUCCESS) return ERROR;
+
+    PipeState state;
+    char line[PipeStateWriter::MAX_LINE];
+    while (reader.next(state)) {
+        if (state.cycle < from || state.cycle > to) continue;
+        if (toStdout) {
+            fwrite(line, 1, PipeStateWriter::formatLine(state, line), stdout);
+        } else if (writer.write(state) != SUCCESS) {
+            return ERROR;
+        }
+    }
+
+    return toStdout ? SUCCESS : writer.close();
+}
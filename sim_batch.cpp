@@ -0,0 +1,256 @@
+/**
+ * sim_batch
+ * Runs every program against every cache config on a pool of threads, in one
+ * process, and writes one table with the SimulationStats of each run.
+ *
+ *   sim_batch [--jobs=N] [--format=csv|json] [--out=FILE] [--max-cycles=N]
+ *             <configs.txt> <file.bin>...
+ *
+ * configs.txt holds one or more sim_cycle cache configs separated by "---" lines.
+ * Each binary is loaded once and every job runs on its own copy of that memory. No
+ * per-run output files are written. --max-cycles stops runs that never halt (status
+ * SUCCESS in the table instead of HALT), and a run that fails stops with ERROR; results
+ * go to stdout unless --out is given.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ElfLoader.h"
+#include "MemoryStore.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include "cache.h"
+#include "cycle.h"
+
+using namespace std;
+
+struct BatchJob {
+    size_t program;
+    size_t config;
+    Status status;
+    SimulationStats stats;
+};
+
+static void runJob(BatchJob& job, const MemoryStore& image, uint32_t entry,
+                   const CacheConfigSet& configs, uint32_t maxCycles) {
+    CycleSimulator simulator;
+    simulator.setOutputFiles(false);
+    if (simulator.init(configs, new MemoryStore(image), "", entry) != SUCCESS) {
+        job.status = ERROR;
+        return;
+    }
+
+    Status status = SUCCESS;
+    for (uint32_t cycles = 0; status == SUCCESS && (maxCycles == 0 || cycles < maxCycles);
+         cycles++) {
+        status = simulator.runCycles(1);
+    }
+    simulator.finalize();
+
+    job.status = status;
+    job.stats = simulator.getStats();
+}
+
+static const char* const CACHE_LEVELS[] = {"ic", "dc", "l2", "l3"};
+
+static const CacheConfig& levelConfig(const CacheConfigSet& configs, int level) {
+    const CacheConfig* levels[] = {&configs.icConfig, &configs.dcConfig, &configs.l2Config,
+                                   &configs.l3Config};
+    return *levels[level];
+}
+
+static void printCacheHeader(ostream& out, const char* level) {
+    for (const char* column : {"Size", "BlockSize", "Ways", "MissLatency", "Policy", "WritePolicy",
+                               "WritebackLatency", "Inclusive", "Prefetcher", "PrefetchDegree",
+                               "PrefetchDistance"}) {
+        out << level << column << ",";
+    }
+}
+
+// an absent L2/L3 prints as empty columns
+static void printCacheColumns(ostream& out, const CacheConfig& config) {
+    if (config.cacheSize == 0) {
+        out << ",,,,,,,,,,,";
+        return;
+    }
+    out << config.cacheSize << "," << config.blockSize << "," << config.ways << ","
+        << config.missLatency << "," << replacementPolicyName(config.policy) << ","
+        << writePolicyName(config.writePolicy) << "," << config.writebackLatency << ","
+        << config.inclusive << "," << prefetcherName(config.prefetcher) << ","
+        << config.prefetchDegree << "," << config.prefetchDistance << ",";
+}
+
+// quoted, with any quote doubled
+static string csvString(const string& s) {
+    string quoted = "\"";
+    for (char c : s) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeCsv(ostream& out, const vector<BatchJob>& jobs, const vector<string>& programs,
+                     const vector<CacheConfigSet>& configs) {
+    out << "program,config,";
+    for (const char* level : CACHE_LEVELS) printCacheHeader(out, level);
+    out << "status,dynamicInstructions,totalCycles,icHits,icMisses,dcHits,dcMisses,l2Hits,"
+           "l2Misses,l3Hits,l3Misses,loadUseStalls,writebacks,writebackBytes,"
+           "icPrefetches,icPrefetchesUseful,icPrefetchesLate,dcPrefetches,dcPrefetchesUseful,"
+           "dcPrefetchesLate\n";
+    for (const auto& job : jobs) {
+        const SimulationStats& s = job.stats;
+        out << csvString(programs[job.program]) << "," << job.config << ",";
+        for (int level = 0; level < 4; level++) {
+            printCacheColumns(out, levelConfig(configs[job.config], level));
+        }
+        out << statusName(job.status) << "," << s.dynamicInstructions << "," << s.totalCycles
+            << "," << s.icHits << "," << s.icMisses << "," << s.dcHits << "," << s.dcMisses << ","
+            << s.l2Hits << "," << s.l2Misses << "," << s.l3Hits << "," << s.l3Misses << ","
+            << s.loadUseStalls << "," << s.writebacks << "," << s.writebackBytes << ","
+            << s.icPrefetches << "," << s.icPrefetchesUseful << "," << s.icPrefetchesLate << ","
+            << s.dcPrefetches << "," << s.dcPrefetchesUseful << "," << s.dcPrefetchesLate << "\n";
+    }
+}
+
+static void printCacheObject(ostream& out, const CacheConfig& config) {
+    if (config.cacheSize == 0) {
+        out << "null";
+        return;
+    }
+    out << "{\"size\": " << config.cacheSize << ", \"blockSize\": " << config.blockSize
+        << ", \"ways\": " << config.ways << ", \"missLatency\": " << config.missLatency
+        << ", \"policy\": \"" << replacementPolicyName(config.policy) << "\", \"writePolicy\": \""
+        << writePolicyName(config.writePolicy)
+        << "\", \"writebackLatency\": " << config.writebackLatency
+        << ", \"inclusive\": " << (config.inclusive ? "true" : "false") << ", \"prefetcher\": \""
+        << prefetcherName(config.prefetcher) << "\", \"prefetchDegree\": " << config.prefetchDegree
+        << ", \"prefetchDistance\": " << config.prefetchDistance << "}";
+}
+
+static string jsonString(const string& s) {
+    string quoted = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeJson(ostream& out, const vector<BatchJob>& jobs, const vector<string>& programs,
+                      const vector<CacheConfigSet>& configs) {
+    out << "[\n";
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchJob& job = jobs[i];
+        const SimulationStats& s = job.stats;
+        out << "  {\"program\": " << jsonString(programs[job.program])
+            << ", \"config\": " << job.config;
+        for (int level = 0; level < 4; level++) {
+            out << ", \"" << CACHE_LEVELS[level] << "Config\": ";
+            printCacheObject(out, levelConfig(configs[job.config], level));
+        }
+        out << ", \"status\": \"" << statusName(job.status) << "\""
+            << ", \"dynamicInstructions\": " << s.dynamicInstructions
+            << ", \"totalCycles\": " << s.totalCycles << ", \"icHits\": " << s.icHits
+            << ", \"icMisses\": " << s.icMisses << ", \"dcHits\": " << s.dcHits
+            << ", \"dcMisses\": " << s.dcMisses << ", \"l2Hits\": " << s.l2Hits
+            << ", \"l2Misses\": " << s.l2Misses << ", \"l3Hits\": " << s.l3Hits
+            << ", \"l3Misses\": " << s.l3Misses << ", \"loadUseStalls\": " << s.loadUseStalls
+            << ", \"writebacks\": " << s.writebacks << ", \"writebackBytes\": " << s.writebackBytes
+            << ", \"icPrefetches\": " << s.icPrefetches
+            << ", \"icPrefetchesUseful\": " << s.icPrefetchesUseful
+            << ", \"icPrefetchesLate\": " << s.icPrefetchesLate
+            << ", \"dcPrefetches\": " << s.dcPrefetches
+            << ", \"dcPrefetchesUseful\": " << s.dcPrefetchesUseful
+            << ", \"dcPrefetchesLate\": " << s.dcPrefetchesLate
+            << "}" << (i + 1 < jobs.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+int main(int argc, char** argv) {
+    unsigned workers = 0;
+    bool json = false;
+    string outFile;
+    uint32_t maxCycles = 0;
+    vector<string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            workers = strtoul(argv[i] + 7, nullptr, 0);
+        } else if (strcmp(argv[i], "--format=csv") == 0) {
+            json = false;
+        } else if (strcmp(argv[i], "--format=json") == 0) {
+            json = true;
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            outFile = argv[i] + 6;
+        } else if (strncmp(argv[i], "--max-cycles=", 13) == 0) {
+            maxCycles = strtoul(argv[i] + 13, nullptr, 0);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
+            return ERROR;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() < 2) {
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0]
+                                         << " [--jobs=N] [--format=csv|json] [--out=FILE]"
+                                            " [--max-cycles=N] <configs.txt> <file.bin|file.elf>...");
+        return ERROR;
+    }
+
+    vector<CacheConfigSet> configs;
+    if (parseCacheConfigFile(positional[0], configs) != SUCCESS) return ERROR;
+
+    vector<string> programs(positional.begin() + 1, positional.end());
+    vector<unique_ptr<MemoryStore>> images;
+    vector<uint32_t> entries(programs.size());
+    for (size_t p = 0; p < programs.size(); p++) {
+        images.emplace_back(new MemoryStore(0, MEMORY_SIZE));
+        if (loadProgram(images.back().get(), programs[p].c_str(), entries[p]) != SUCCESS) {
+            return ERROR;
+        }
+    }
+
+    vector<BatchJob> jobs;
+    for (size_t p = 0; p < programs.size(); p++) {
+        for (size_t c = 0; c < configs.size(); c++) jobs.push_back({p, c, SUCCESS, {}});
+    }
+
+    {
+        ThreadPool pool(workers);
+        TRACE_INFO(TRACE_SIM, "Running " << jobs.size() << " jobs on " << pool.size() << " threads");
+        for (auto& job : jobs) {
+            BatchJob* j = &job;
+            pool.submit([j, &images, &entries, &configs, maxCycles] {
+                runJob(*j, *images[j->program], entries[j->program], configs[j->config],
+                       maxCycles);
+            });
+        }
+        pool.wait();
+    }
+
+    ofstream file;
+    if (!outFile.empty()) {
+        file.open(outFile);
+        if (!file) {
+            TRACE_ERROR(TRACE_SIM, "Could not create batch results file " << outFile);
+            return ERROR;
+        }
+    }
+    ostream& out = outFile.empty() ? cout : file;
+    if (json) {
+        writeJson(out, jobs, programs, configs);
+    } else {
+        writeCsv(out, jobs, programs, configs);
+    }
+    return SUCCESS;
+}
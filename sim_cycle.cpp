@@ -3,92 +3,123 @@
  * but we may use a different main() to grade, so do not put any simulation
  * logic here.
  */
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include "cache.h"
+#include "ElfLoader.h"
 #include "MemoryStore.h"
 #include "Utilities.h"
 #include "cycle.h"
 
 using namespace std;
 
-inline std::tuple<std::string, CacheConfig, CacheConfig> parseArgs(int argc, char** argv) {
-    if (argc != 3) {
-        std::cerr << LOG_ERROR << "Usage: " << argv[0] << " <file.bin> <cache_config.txt>"
-                  << std::endl
-                  << "Note:" << std::endl
-                  << "The sim_cycle binary should take two command-line arguments indicating the "
-                     "name of the binary file to be read and the cache configuration file to be "
-                     "used. [See detail in project description document]."
-                  << std::endl;
+// bytes of memory the program may use, --full-memory for all 4 GB
+static uint64_t memorySize = MEMORY_SIZE;
+// --restore: a checkpoint to start from instead of the program's first instruction
+static const char* restoreFile = nullptr;
+// --fast-forward, --fast-forward-to and --warm-caches: run functionally up to here first
+static uint32_t fastForwardInstructions = 0;
+static uint32_t fastForwardPc = CycleSimulator::NO_TARGET_PC;
+static bool warmCaches = false;
+
+inline std::tuple<std::string, CacheConfigSet> parseArgs(int argc, char** argv) {
+    if (argc < 3) {
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0] << " <file.bin|file.elf> <cache_config.txt>"
+                                         << " [--pipe-trace=text|binary] [--full-memory]"
+                                         << " [--checkpoint-every=N] [--restore=FILE]"
+                                         << " [--fast-forward=N] [--fast-forward-to=PC]"
+                                         << " [--warm-caches]"
+                                         << std::endl
+                                         << "Note:" << std::endl
+                                         << "The sim_cycle binary should take two command-line "
+                                            "arguments indicating the name of the binary file to "
+                                            "be read and the cache configuration file to be used. "
+                                            "[See detail in project description document].");
         exit(ERROR);
     }
 
-    try {
-        std::string inputFile = argv[1];
-        std::string cacheFile = argv[2];
-
-        std::ifstream file(cacheFile);
-        if (!file.is_open()) {
-            std::cerr << LOG_ERROR << "Failed to open cache config file: " << cacheFile
-                      << std::endl;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--pipe-trace=binary") == 0) {
+            setPipeTraceFormat(PIPE_TRACE_BINARY);
+        } else if (strcmp(argv[i], "--pipe-trace=text") == 0) {
+            setPipeTraceFormat(PIPE_TRACE_TEXT);
+        } else if (strcmp(argv[i], "--full-memory") == 0) {
+            memorySize = FULL_MEMORY_SIZE;
+        } else if (strncmp(argv[i], "--checkpoint-every=", 19) == 0) {
+            setCheckpointInterval(strtoul(argv[i] + 19, nullptr, 0));
+        } else if (strncmp(argv[i], "--restore=", 10) == 0) {
+            restoreFile = argv[i] + 10;
+        } else if (strncmp(argv[i], "--fast-forward=", 15) == 0) {
+            fastForwardInstructions = strtoul(argv[i] + 15, nullptr, 0);
+        } else if (strncmp(argv[i], "--fast-forward-to=", 18) == 0) {
+            fastForwardPc = strtoul(argv[i] + 18, nullptr, 0);
+        } else if (strcmp(argv[i], "--warm-caches") == 0) {
+            warmCaches = true;
+        } else {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
             exit(ERROR);
         }
+    }
 
-        int line = 0;
-        auto parseNextLine = [&](const char* name) -> uint32_t {
-            line++;
-            uint32_t value;
-            if (!(file >> value)) {
-                std::stringstream errorMessage;
-                errorMessage << "Failed to parse property at line " << line << " for property "
-                             << name;
-                throw std::invalid_argument(errorMessage.str());
-            }
-            std::string discard;
-            std::getline(file, discard);  // discard rest of the line
-            return value;
-        };
-
-        CacheConfig icConfig{parseNextLine("ICache cache size"), parseNextLine("ICache block size"),
-                             parseNextLine("ICache ways"), parseNextLine("ICache miss latency")};
-
-        CacheConfig dcConfig{parseNextLine("DCache cache size"), parseNextLine("DCache block size"),
-                             parseNextLine("DCache ways"), parseNextLine("DCache miss latency")};
-
-        std::cout << LOG_INFO << LOG_VAR(icConfig) << std::endl;
-        std::cout << LOG_INFO << LOG_VAR(dcConfig) << std::endl;
-
-        return std::make_tuple(inputFile, icConfig, dcConfig);
-
-    } catch (const std::invalid_argument& e) {
-        std::cerr << LOG_ERROR << e.what() << std::endl;
-        exit(ERROR);
-    } catch (const std::out_of_range& e) {
-        std::cerr << LOG_ERROR << "One of the integer arguments is out of range." << std::endl;
+    std::vector<CacheConfigSet> configs;
+    if (parseCacheConfigFile(argv[2], configs) != SUCCESS) exit(ERROR);
+    if (configs.size() > 1) {
+        TRACE_ERROR(TRACE_SIM, argv[2] << " holds " << configs.size()
+                                       << " configs, use sim_batch to run several");
         exit(ERROR);
     }
+
+    CacheConfig icConfig = configs[0].icConfig;
+    CacheConfig dcConfig = configs[0].dcConfig;
+    TRACE_INFO(TRACE_SIM, LOG_VAR(icConfig));
+    TRACE_INFO(TRACE_SIM, LOG_VAR(dcConfig));
+    if (configs[0].l2Config.cacheSize > 0) {
+        CacheConfig l2Config = configs[0].l2Config;
+        TRACE_INFO(TRACE_SIM, LOG_VAR(l2Config));
+    }
+    if (configs[0].l3Config.cacheSize > 0) {
+        CacheConfig l3Config = configs[0].l3Config;
+        TRACE_INFO(TRACE_SIM, LOG_VAR(l3Config));
+    }
+
+    return std::make_tuple(std::string(argv[1]), configs[0]);
 }
 
 int main(int argc, char** argv) {
     auto simArgs = parseArgs(argc, argv);
     auto inputFile = std::get<0>(simArgs);
-    auto iCacheConfig = std::get<1>(simArgs);
-    auto dCacheConfig = std::get<2>(simArgs);
+    auto cacheConfigs = std::get<1>(simArgs);
 
     cout << "[Simulator] Loading memory from " << LOG_VAR(inputFile) << endl;
     auto baseFilename = getBaseFilename(argv[1]) + "_cycle";
-    initSimulator(iCacheConfig, dCacheConfig, new MemoryStore(0, MEMORY_SIZE, argv[1]),
-                  baseFilename);
+    MemoryStore* memory = new MemoryStore(0, memorySize);
+    uint32_t entry = 0;
+    if (!restoreFile && loadProgram(memory, argv[1], entry) != SUCCESS) {
+        delete memory;
+        return ERROR;
+    }
+    initSimulator(cacheConfigs, memory, baseFilename, entry);
+    if (restoreFile) {
+        cout << "[Simulator] Restoring " << LOG_VAR(restoreFile) << endl;
+        if (restoreSimulator(restoreFile) != SUCCESS) return ERROR;
+    }
+    if (fastForwardInstructions > 0 || fastForwardPc != CycleSimulator::NO_TARGET_PC) {
+        uint32_t executed;
+        fastForwardSimulator(fastForwardInstructions, fastForwardPc, warmCaches, executed);
+        cout << "[Simulator] Fast-forwarded " << executed << " instructions"
+             << (warmCaches ? ", caches warmed" : "") << endl;
+    }
 
     cout << "[Simulator] Start simulator" << endl;
     auto status = runTillHalt();
     // auto status = runCycles(0);
 
+    if (status == ERROR) TRACE_ERROR(TRACE_SIM, "Simulation stopped before the program halted");
     cout << "[Simulator] Finished emulation status: " << status << endl;
     finalizeSimulator();
 
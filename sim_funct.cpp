@@ -4,8 +4,11 @@
  * logics here.
  */
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+#include "ElfLoader.h"
 #include "MemoryStore.h"
 #include "Utilities.h"
 #include "funct.h"
@@ -14,17 +17,56 @@ using namespace std;
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        cerr << LOG_ERROR << "Usage: " << argv[0] << " <input_file>" << endl;
+        TRACE_ERROR(TRACE_SIM,
+                    "Usage: " << argv[0]
+                              << " <input_file> [--engine=interp|threaded|jit] [--access-trace]"
+                                 " [--full-memory] [--checkpoint-every=N] [--restore=FILE]");
         return ERROR;
     }
 
+    // bytes of memory the program may use, --full-memory for all 4 GB
+    uint64_t memorySize = MEMORY_SIZE;
+    // a checkpoint to start from instead of the program's first instruction
+    const char* restoreFile = nullptr;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--engine=threaded") == 0) {
+            setExecutionEngine(ENGINE_THREADED);
+        } else if (strcmp(argv[i], "--engine=jit") == 0) {
+            setExecutionEngine(ENGINE_JIT);
+        } else if (strcmp(argv[i], "--engine=interp") == 0) {
+            setExecutionEngine(ENGINE_INTERPRETER);
+        } else if (strcmp(argv[i], "--access-trace") == 0) {
+            setAccessTrace(true);
+        } else if (strcmp(argv[i], "--full-memory") == 0) {
+            memorySize = FULL_MEMORY_SIZE;
+        } else if (strncmp(argv[i], "--checkpoint-every=", 19) == 0) {
+            setCheckpointInterval(strtoul(argv[i] + 19, nullptr, 0));
+        } else if (strncmp(argv[i], "--restore=", 10) == 0) {
+            restoreFile = argv[i] + 10;
+        } else {
+            TRACE_ERROR(TRACE_SIM, "Unknown option " << argv[i]);
+            return ERROR;
+        }
+    }
+
     cout << "[Simulator] Loading memory from " << LOG_VAR(argv[1]) << endl;
     auto baseFilename = getBaseFilename(argv[1]) + "_funct";
-    initEmulator(new MemoryStore(0, MEMORY_SIZE, argv[1]), baseFilename);
+    MemoryStore* memory = new MemoryStore(0, memorySize);
+    uint32_t entry = 0;
+    if (!restoreFile && loadProgram(memory, argv[1], entry) != SUCCESS) {
+        delete memory;
+        return ERROR;
+    }
+    if (initEmulator(memory, baseFilename, entry) != SUCCESS) return ERROR;
+    if (restoreFile) {
+        cout << "[Simulator] Restoring " << LOG_VAR(restoreFile) << endl;
+        if (restoreEmulator(restoreFile) != SUCCESS) return ERROR;
+    }
 
     cout << "[Simulator] Start emulation" << endl;
     auto status = runTillHalt();
 
+    if (status == ERROR) TRACE_ERROR(TRACE_SIM, "Emulation stopped before the program halted");
     cout << "[Simulator] Finished emulation status: " << status << endl;
     finalizeEmulator();
 
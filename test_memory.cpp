@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include "Checkpoint.h"
 #include "Utilities.h"
 #include "MemoryStore.h"
 
@@ -18,7 +19,7 @@ int main(int argc, char** argv) {
     std::cout << "Memory Test" << std::endl;
 
     if (argc < 2) {
-        cerr << LOG_ERROR << "Usage: " << argv[0] << " <input_file>" << endl;
+        TRACE_ERROR(TRACE_SIM, "Usage: " << argv[0] << " <input_file>");
         return ERROR;
     }
 
@@ -32,5 +33,58 @@ int main(int argc, char** argv) {
         if (value != 0) cout << hex << "Memory[" << i << "] = " << value << endl;
     }
 
+    // the fast accessors must agree with getMemValue at every size and alignment
+    bool same = true;
+    for (uint32_t i = 0; i < MEMORY_SIZE; i++) {
+        uint32_t slow, fast;
+        mem->getMemValue(i, slow, BYTE_SIZE);
+        same &= mem->read8(i, fast) && fast == slow;
+        if (i + HALF_SIZE <= MEMORY_SIZE) {
+            mem->getMemValue(i, slow, HALF_SIZE);
+            same &= mem->read16(i, fast) && fast == slow;
+        }
+        if (i + WORD_SIZE <= MEMORY_SIZE) {
+            mem->getMemValue(i, slow, WORD_SIZE);
+            same &= mem->read32(i, fast) && fast == slow;
+        }
+    }
+    uint32_t value;
+    mem->write32(0x100, 0x12345678);
+    mem->getMemValue(0x101, value, HALF_SIZE);
+    same &= value == 0x3456 && !mem->read32(MEMORY_SIZE - 2, value);
+    cout << "Fast accessors: " << (same ? "Passed" : "Failed") << endl;
+
+    // a full 32-bit store only allocates the pages that are touched
+    MemoryStore full(0, FULL_MEMORY_SIZE);
+    bool sparse = full.write32(0xfffffffc, 0xdeadbeef) && full.write32(0x80000ffe, 0x01020304);
+    sparse &= full.read32(0xfffffffc, value) && value == 0xdeadbeef;
+    sparse &= full.read16(0x80001000, value) && value == 0x0304;
+    sparse &= full.read32(0x40000000, value) && value == 0 && full.getPageCount() == 4;
+    cout << "Sparse memory: " << (sparse ? "Passed" : "Failed") << endl;
+
+    // copies share pages until one side writes them
+    MemoryStore fork(full);
+    bool cow = fork.write32(0xfffffffc, 1) && full.write32(0x80000ffc, 2);
+    cow &= full.read32(0xfffffffc, value) && value == 0xdeadbeef;
+    cow &= fork.read32(0xfffffffc, value) && value == 1;
+    cow &= fork.read32(0x80000ffc, value) && value == 0x0102;
+    // each side's copy of the two written pages is its own, the other two stay shared
+    cow &= fork.getPageCount() == 4 && fork.getPrivatePageCount() == 2;
+    cow &= full.getPrivatePageCount() == 2;
+    cout << "Copy-on-write: " << (cow ? "Passed" : "Failed") << endl;
+
+    // a checkpoint keeps the size and the pages that are not all zeros
+    CheckpointWriter out;
+    bool saved = out.open("test_memory_checkpoint.bin", CHECKPOINT_FUNCTIONAL) == SUCCESS;
+    fork.save(out);
+    saved &= out.close() == SUCCESS;
+    MemoryStore loaded(0, MEMORY_SIZE);
+    CheckpointReader in;
+    saved &= in.open("test_memory_checkpoint.bin") == SUCCESS && loaded.load(in) == 0;
+    saved &= loaded.read32(0xfffffffc, value) && value == 1 && loaded.getPageCount() == 3;
+    saved &= loaded.read16(0x80001000, value) && value == 0x0304;
+    remove("test_memory_checkpoint.bin");
+    cout << "Checkpoint: " << (saved ? "Passed" : "Failed") << endl;
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,324 @@
+/**
+ * threaded.cpp
+ * Threaded-code execution engine for Emulator.
+ *
+ * Straight-line runs of instructions are gathered into blocks of pre-resolved
+ * operations and executed with one indirect jump per instruction (computed goto
+ * where the compiler supports it, a switch otherwise), instead of going through
+ * executeInstruction() and its InstructionInfo for every instruction.
+ */
+
+#include <cassert>
+#include <iostream>
+
+#include "emulator.h"
+
+using namespace std;
+
+#if defined(__GNUC__)
+#define THREADED_COMPUTED_GOTO 1
+// labels as values are a GNU extension, keep `make debug` (-pedantic) quiet about them
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define THREADED_COMPUTED_GOTO 0
+#endif
+
+void Emulator::flushBlocks() {
+    for (auto& block : blockCache) {
+        block.valid = false;
+        block.ops.clear();
+    }
+    for (auto& entry : decodeCache) entry.inBlock = false;
+    flushJit();
+    codeModified = false;
+}
+
+// find the block starting at pc, building it if needed. An empty block means the very
+// first fetch faulted and the caller has to fall back to executeInstruction().
+Emulator::ThreadedBlock& Emulator::lookupBlock(uint32_t pc) {
+    ThreadedBlock& block = blockCache[(pc >> 2) % BLOCK_CACHE_ENTRIES];
+    if (block.valid && block.pc == pc) return block;
+
+    block.pc = pc;
+    block.valid = true;
+    block.resolved = false;
+    block.ops.clear();
+
+    DecodedInstruction scratch;
+    bool delaySlot = false;
+    for (uint32_t p = pc; block.ops.size() < MAX_BLOCK_OPS; p += 4) {
+        const DecodedInstruction& d = fetchDecoded(p, scratch);
+        if (&d == &scratch) break;  // faulting fetches are left to the interpreter
+
+        decodeCache[(p >> 2) % DECODE_CACHE_ENTRIES].inBlock = true;
+        block.ops.push_back({nullptr, d.kind, &d});
+
+        if (delaySlot || d.kind == K_HALT || d.kind == K_ILLEGAL) break;
+        // control transfers end the block once their delay slot is in
+        delaySlot = isControlTransfer(d.kind);
+    }
+    return block;
+}
+
+uint32_t Emulator::runThreaded(uint32_t maxInstructions, bool& halted) {
+    assert(memory);
+    uint32_t* regs = regData.registers;
+    uint32_t executed = 0;
+    halted = false;
+
+#if THREADED_COMPUTED_GOTO
+    static const void* const labels[NUM_OP_KINDS] = {
+        &&L_K_ADD,  &&L_K_ADDU, &&L_K_AND,  &&L_K_JR,   &&L_K_NOR,   &&L_K_OR,
+        &&L_K_SLT,  &&L_K_SLTU, &&L_K_SLL,  &&L_K_SRL,  &&L_K_SUB,   &&L_K_SUBU,
+        &&L_K_ILLEGAL_FUNCT,
+        &&L_K_ADDI, &&L_K_ADDIU, &&L_K_ANDI, &&L_K_BEQ, &&L_K_BNE,   &&L_K_BLEZ,
+        &&L_K_BGTZ, &&L_K_J,    &&L_K_JAL,  &&L_K_LBU,  &&L_K_LHU,   &&L_K_LUI,
+        &&L_K_LW,   &&L_K_ORI,  &&L_K_SLTI, &&L_K_SLTIU, &&L_K_SB,   &&L_K_SH,
+        &&L_K_SW,   &&L_K_ILLEGAL,
+        &&L_K_HALT,
+    };
+#define OP(kind) L_##kind:
+#define JUMP() goto *op->target
+#else
+#define OP(kind) case kind:
+#define JUMP() goto dispatch
+#endif
+
+    // Per-instruction bookkeeping shared with executeInstruction(): advance PC (taking a
+    // pending branch if this is its delay slot), clear $zero, count the instruction.
+#define BEGIN_OP()                         \
+    do {                                   \
+        if (encounteredBranch) {           \
+            PC = savedBranch;              \
+            encounteredBranch = false;     \
+        } else {                           \
+            PC += 4;                       \
+        }                                  \
+        regs[0] = 0;                       \
+        din += 1;                          \
+        executed += 1;                     \
+    } while (0)
+
+#define NEXT()                             \
+    do {                                   \
+        if (++op == end) goto block_done;  \
+        d = op->d;                         \
+        BEGIN_OP();                        \
+        JUMP();                            \
+    } while (0)
+
+    while (maxInstructions == 0 || executed < maxInstructions) {
+        if (codeModified) flushBlocks();
+
+        ThreadedBlock* block = encounteredBranch ? nullptr : &lookupBlock(PC);
+        uint32_t remaining = maxInstructions ? maxInstructions - executed : 0;
+
+        // Mid-delay-slot entry, faulting fetch, or not enough budget left for the whole
+        // block: take a single interpreted step instead.
+        if (!block || block->ops.empty() || (maxInstructions && block->ops.size() > remaining)) {
+            InstructionInfo info = executeInstruction();
+            executed += 1;
+            if (info.isHalt) {
+                halted = true;
+                break;
+            }
+            continue;
+        }
+
+#if THREADED_COMPUTED_GOTO
+        if (!block->resolved) {
+            for (auto& o : block->ops) o.target = labels[o.kind];
+            block->resolved = true;
+        }
+#endif
+
+        const ThreadedOp* op = block->ops.data();
+        const ThreadedOp* end = op + block->ops.size();
+        const DecodedInstruction* d = op->d;
+        InstructionInfo info;
+        BEGIN_OP();
+
+#if THREADED_COMPUTED_GOTO
+        JUMP();
+#else
+    dispatch:
+        switch (op->kind) {
+#endif
+        OP(K_ADD) {
+            opAdd(*d, info);
+            if (info.isOverflow) goto block_exit;
+            NEXT();
+        }
+        OP(K_ADDU) {
+            regs[d->rd] = regs[d->rs] + regs[d->rt];
+            NEXT();
+        }
+        OP(K_AND) {
+            regs[d->rd] = regs[d->rs] & regs[d->rt];
+            NEXT();
+        }
+        OP(K_JR) {
+            encounteredBranch = true;
+            savedBranch = regs[d->rs];
+            NEXT();
+        }
+        OP(K_NOR) {
+            regs[d->rd] = ~(regs[d->rs] | regs[d->rt]);
+            NEXT();
+        }
+        OP(K_OR) {
+            regs[d->rd] = regs[d->rs] | regs[d->rt];
+            NEXT();
+        }
+        OP(K_SLT) {
+            regs[d->rd] = (int32_t(regs[d->rs]) < int32_t(regs[d->rt])) ? 1 : 0;
+            NEXT();
+        }
+        OP(K_SLTU) {
+            regs[d->rd] = (regs[d->rs] < regs[d->rt]) ? 1 : 0;
+            NEXT();
+        }
+        OP(K_SLL) {
+            regs[d->rd] = regs[d->rt] << d->shamt;
+            NEXT();
+        }
+        OP(K_SRL) {
+            regs[d->rd] = regs[d->rt] >> d->shamt;
+            NEXT();
+        }
+        OP(K_SUB) {
+            regs[d->rd] = regs[d->rs] - regs[d->rt];
+            NEXT();
+        }
+        OP(K_SUBU) {
+            opSubu(*d, info);
+            if (info.isOverflow) goto block_exit;
+            NEXT();
+        }
+        OP(K_ILLEGAL_FUNCT) {
+            opIllegalFunct(*d, info);
+            NEXT();
+        }
+        OP(K_ADDI) {
+            opAddi(*d, info);
+            if (info.isOverflow) goto block_exit;
+            NEXT();
+        }
+        OP(K_ADDIU) {
+            regs[d->rt] = regs[d->rs] + d->signExtImm;
+            NEXT();
+        }
+        OP(K_ANDI) {
+            regs[d->rt] = regs[d->rs] & d->zeroExtImm;
+            NEXT();
+        }
+        OP(K_BEQ) {
+            if (regs[d->rs] == regs[d->rt]) {
+                encounteredBranch = true;
+                savedBranch = PC + d->branchAddr;
+            }
+            NEXT();
+        }
+        OP(K_BNE) {
+            if (regs[d->rs] != regs[d->rt]) {
+                encounteredBranch = true;
+                savedBranch = PC + d->branchAddr;
+            }
+            NEXT();
+        }
+        OP(K_BLEZ) {
+            if (regs[d->rs] == 0 || (regs[d->rs] & 0x80000000)) {
+                encounteredBranch = true;
+                savedBranch = PC + d->branchAddr;
+            }
+            NEXT();
+        }
+        OP(K_BGTZ) {
+            if (!(regs[d->rs] & 0x80000000) && regs[d->rs] != 0) {
+                encounteredBranch = true;
+                savedBranch = PC + d->branchAddr;
+            }
+            NEXT();
+        }
+        OP(K_J) {
+            encounteredBranch = true;
+            savedBranch = (PC & 0xf0000000) ^ (d->address << 2);
+            NEXT();
+        }
+        OP(K_JAL) {
+            encounteredBranch = true;
+            regs[31] = PC + 4;
+            savedBranch = (PC & 0xf0000000) ^ (d->address << 2);
+            NEXT();
+        }
+        OP(K_LBU) {
+            memory->read8(regs[d->rs] + d->signExtImm, regs[d->rt]);
+            NEXT();
+        }
+        OP(K_LHU) {
+            memory->read16(regs[d->rs] + d->signExtImm, regs[d->rt]);
+            NEXT();
+        }
+        OP(K_LUI) {
+            regs[d->rt] = d->zeroExtImm << 16;
+            NEXT();
+        }
+        OP(K_LW) {
+            memory->read32(regs[d->rs] + d->signExtImm, regs[d->rt]);
+            NEXT();
+        }
+        OP(K_ORI) {
+            regs[d->rt] = regs[d->rs] | d->zeroExtImm;
+            NEXT();
+        }
+        OP(K_SLTI) {
+            regs[d->rt] = (int32_t(regs[d->rs]) < int32_t(d->signExtImm)) ? 1 : 0;
+            NEXT();
+        }
+        OP(K_SLTIU) {
+            regs[d->rt] = (regs[d->rs] < uint32_t(d->signExtImm)) ? 1 : 0;
+            NEXT();
+        }
+        // stores may rewrite instructions this block is made of, stop if they did
+        OP(K_SB) {
+            opSb(*d, info);
+            if (codeModified) goto block_exit;
+            NEXT();
+        }
+        OP(K_SH) {
+            opSh(*d, info);
+            if (codeModified) goto block_exit;
+            NEXT();
+        }
+        OP(K_SW) {
+            opSw(*d, info);
+            if (codeModified) goto block_exit;
+            NEXT();
+        }
+        OP(K_ILLEGAL) {
+            opIllegal(*d, info);
+            goto block_exit;
+        }
+        OP(K_HALT) {
+            halted = true;
+            goto block_exit;
+        }
+#if !THREADED_COMPUTED_GOTO
+        default:
+            assert(false);
+        }
+#endif
+
+    block_done:
+        continue;
+    block_exit:
+        if (halted) break;
+    }
+
+#undef OP
+#undef JUMP
+#undef BEGIN_OP
+#undef NEXT
+
+    return executed;
+}